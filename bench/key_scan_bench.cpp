@@ -0,0 +1,209 @@
+// Checks the key scanners against the scalar functions on random strings,
+// then times them on short and long keys.
+// Build with: cmake --build build --target key_scan_bench
+#include "../src/jsonutils.hpp"
+#include "../src/key_scan.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+// Room after the closing quote, like SIMDJSON_PADDING
+const size_t padding = 64;
+
+// Keys stored one after the other, each followed by its closing quote and
+// padding
+struct key_set
+{
+    std::string buffer;
+    std::vector<size_t> offsets;
+
+    void add(const std::string &key)
+    {
+        offsets.push_back(buffer.size());
+        buffer += key;
+        buffer += '"';
+        buffer.append(padding, ' ');
+    }
+
+    const char *key(size_t i) const { return buffer.data() + offsets[i]; }
+};
+
+static std::string random_string(std::mt19937 &rng, size_t len)
+{
+    // Mostly identifier characters, with the ones the kernels look for
+    static const std::string alphabet =
+        "abcxyzABCXYZ_0189@[`{/:-$ \x7f\x80\xe9\"\\\\\n\r";
+    std::string s;
+    for (size_t i = 0; i < len; i++)
+    {
+        s += alphabet[rng() % alphabet.size()];
+    }
+    if (rng() % 4 == 0 && len > 0)
+    {
+        s[rng() % len] = 0;
+    }
+    return s;
+}
+
+static bool check(const key_scanner &scanner)
+{
+    std::mt19937 rng(1);
+    for (int n = 0; n < 1000000; n++)
+    {
+        std::string s = random_string(rng, rng() % 100);
+        // Without a quote in s, scan_padded_key stops at the one after it
+        std::string padded = s + '"' + std::string(padding, ' ');
+        int length = raw_json_string_length(padded.c_str());
+        raw_key scanned = scanner.scan_padded_key(padded.c_str());
+        bool identifier =
+            length != -1 && is_js_identifier(string_view(s).substr(0, length));
+        if (scanned.length != length || scanned.identifier != identifier ||
+            scanner.string_length(s) != raw_json_string_length(string_view(s)) ||
+            scanner.is_identifier(s) != is_js_identifier(s))
+        {
+            printf("%s differs on string %d\n", scanner.name, n);
+            return false;
+        }
+    }
+    // nested_end against the scalar scanner, on JSON-like text fed in two
+    // pieces from inside an array
+    const key_scanner &scalar = *supported_key_scanners().front();
+    for (int n = 0; n < 1000000; n++)
+    {
+        // Half of them without escapes, which are followed differently
+        const char *nesting = n % 2 ? "ab \"\\[]{}" : "ab \"[]{}";
+        size_t nesting_len = strlen(nesting);
+        std::string s;
+        for (size_t len = rng() % 200; s.size() < len;)
+        {
+            s += nesting[rng() % nesting_len];
+        }
+        string_view view(s);
+        size_t cut = rng() % (s.size() + 1);
+        int depth[2] = {1 + int(rng() % 3), 0};
+        depth[1] = depth[0];
+        bool in_string[2] = {false, false};
+        bool in_escape[2] = {false, false};
+        size_t end[2];
+        const key_scanner *scanners[2] = {&scanner, &scalar};
+        for (int k = 0; k < 2; k++)
+        {
+            end[k] = scanners[k]->nested_end(
+                view.substr(0, cut), depth[k], in_string[k], in_escape[k]
+            );
+            if (end[k] == cut && depth[k] > 0)
+            {
+                end[k] = cut + scanners[k]->nested_end(
+                                   view.substr(cut), depth[k], in_string[k],
+                                   in_escape[k]
+                               );
+            }
+        }
+        if (end[0] != end[1] || depth[0] != depth[1] ||
+            in_string[0] != in_string[1] || in_escape[0] != in_escape[1])
+        {
+            printf("%s differs on nesting %d\n", scanner.name, n);
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename F> static double time_ns(size_t count, F f)
+{
+    const int rounds = 200;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; r++)
+    {
+        f();
+    }
+    std::chrono::duration<double, std::nano> d =
+        std::chrono::steady_clock::now() - start;
+    return d.count() / rounds / count;
+}
+
+static void bench(const char *name, const key_set &keys)
+{
+    printf("%s keys:\n", name);
+    size_t count = keys.offsets.size();
+    std::vector<string_view> views;
+    for (size_t i = 0; i < count; i++)
+    {
+        views.emplace_back(keys.key(i), raw_json_string_length(keys.key(i)));
+    }
+    for (auto scanner : supported_key_scanners())
+    {
+        volatile size_t sink = 0;
+        double scan = time_ns(
+            count,
+            [&]()
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    raw_key k = scanner->scan_padded_key(keys.key(i));
+                    sink = sink + k.length + k.identifier;
+                }
+            }
+        );
+        double length = time_ns(
+            count,
+            [&]()
+            {
+                for (size_t i = 0; i < count; i++)
+                {
+                    sink = sink + scanner->string_length(
+                                      string_view(keys.key(i), padding)
+                                  );
+                }
+            }
+        );
+        double identifier = time_ns(
+            count,
+            [&]()
+            {
+                for (auto view : views)
+                {
+                    sink = sink + scanner->is_identifier(view);
+                }
+            }
+        );
+        printf(
+            "  %-7s key %5.1f ns  length %5.1f ns  identifier %5.1f ns\n",
+            scanner->name, scan, length, identifier
+        );
+    }
+}
+
+int main()
+{
+    for (auto scanner : supported_key_scanners())
+    {
+        if (!check(*scanner))
+        {
+            return 1;
+        }
+    }
+    std::mt19937 rng(2);
+    const char *letters = "abcdefghijklmnopqrstuvwxyz_0123456789";
+    key_set short_keys, long_keys;
+    for (int i = 0; i < 10000; i++)
+    {
+        std::string key(3 + rng() % 10, 'a');
+        for (size_t j = 1; j < key.size(); j++)
+        {
+            key[j] = letters[rng() % 37];
+        }
+        short_keys.add(key);
+        key.resize(40 + rng() % 60, 'k');
+        if (i % 2)
+        {
+            key[key.size() / 2] = ' ';
+        }
+        long_keys.add(key);
+    }
+    bench("Short (3-12 byte)", short_keys);
+    bench("Long (40-100 byte)", long_keys);
+}
@@ -0,0 +1,118 @@
+// Times printing unbalanced documents on 1 to 16 threads, where the big
+// arrays are nested in objects or next to many small ones. The output is
+// discarded.
+// Build with: cmake --build build --target split_bench
+#include "../src/batched_print.hpp"
+#include "../src/print_gron.hpp"
+#include "../src/print_split.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <string>
+#include <unistd.h>
+
+static std::string record(int i)
+{
+    return "{\"id\":" + std::to_string(i) + ",\"name\":\"n" +
+           std::to_string(i) + "\",\"tags\":[\"a\",\"b\"],\"v\":" +
+           std::to_string(i * 0.37) + "}";
+}
+
+static std::string records(int from, int to)
+{
+    std::string s = "[";
+    for (int i = from; i < to; i++)
+    {
+        s += (i > from ? "," : "") + record(i);
+    }
+    return s + "]";
+}
+
+// A table nested two levels deep in an object, after a small header
+static std::string nested_rows()
+{
+    return "{\"meta\":{\"version\":1,\"source\":\"bench\"},\"data\":{\"count\":"
+           "600000,\"rows\":" +
+           records(0, 600000) + "},\"tail\":[1,2,3]}";
+}
+
+// A long array of numbers, many tiny arrays, an array of arrays of records
+// and records deep in objects
+static std::string skewed_arrays()
+{
+    std::string s = "[[";
+    for (int i = 0; i < 1000000; i++)
+    {
+        s += (i ? "," : "") + std::to_string(i);
+    }
+    s += "]";
+    for (int i = 0; i < 2000; i++)
+    {
+        s += ",[" + std::to_string(i) + "," + std::to_string(i + 1) + "]";
+    }
+    s += ",[";
+    for (int j = 0; j < 200; j++)
+    {
+        s += (j ? "," : "") + records(j * 1000, (j + 1) * 1000);
+    }
+    s += "],{\"deep\":{\"deeper\":[{\"x\":" + records(0, 100000) + "}]}}]";
+    return s;
+}
+
+static double print_ms(simdjson::padded_string &json, unsigned threads)
+{
+    simdjson::ondemand::parser parser;
+    vector<string> filters;
+    double best = 1e9;
+    for (int run = 0; run < 3; run++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        simdjson::ondemand::document doc = parser.iterate(json);
+        growing_string path("json");
+        // The piece size fastgron picks by default
+        size_t piece_size = std::clamp(
+            json.size() / (4 * threads), size_t(1) << 18, size_t(1) << 21
+        );
+        if (threads == 1 ||
+            !print_gron_split(
+                doc, json, path, SPACES, filters, threads, piece_size
+            ))
+        {
+            print_gron_document(doc, path, batched_out, SPACES, filters);
+        }
+        batched_print_flush();
+        std::chrono::duration<double, std::milli> d =
+            std::chrono::steady_clock::now() - start;
+        best = std::min(best, d.count());
+    }
+    return best;
+}
+
+int main()
+{
+    // Results go to the original standard output, the gron output is
+    // discarded
+    FILE *report = fdopen(dup(1), "w");
+    dup2(open("/dev/null", O_WRONLY), 1);
+    struct
+    {
+        const char *name;
+        std::string json;
+    } documents[] = {
+        {"Nested rows", nested_rows()}, {"Skewed arrays", skewed_arrays()}};
+    for (auto &document : documents)
+    {
+        simdjson::padded_string json(document.json);
+        fprintf(report, "%s (%zu MB):\n", document.name, json.size() >> 20);
+        double serial = print_ms(json, 1);
+        for (unsigned threads = 1; threads <= 16; threads *= 2)
+        {
+            double ms = threads == 1 ? serial : print_ms(json, threads);
+            fprintf(
+                report, "  %2u threads %7.1f ms  %4.2fx\n", threads, ms,
+                serial / ms
+            );
+        }
+    }
+}
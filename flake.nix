@@ -28,7 +28,7 @@
         ...
       }: let
         nativeBuildInputs = with pkgs; [cmake clang];
-        buildInputs = with pkgs; [curl openssl zlib];
+        buildInputs = with pkgs; [curl openssl xz zlib zstd];
         fastgron = pkgs.stdenv.mkDerivation {
           pname = "fastgron";
           version = inputs.self.shortRev or inputs.self.dirtyShortRev or inputs.self.lastModified or "development";
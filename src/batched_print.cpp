@@ -1,3 +1,4 @@
 #include "batched_print.hpp"
 
-growing_string batched_out;
+thread_local growing_string batched_out;
+thread_local std::function<void(string_view)> batched_flush_handler;
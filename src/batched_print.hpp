@@ -1,5 +1,8 @@
 #pragma once
 #include "growing_string.hpp"
+#include "output_writer.hpp"
+#include <cerrno>
+#include <functional>
 #include <iostream>
 using std::cerr;
 #ifdef _MSC_VER
@@ -9,16 +12,30 @@ typedef SSIZE_T ssize_t;
 #include <unistd.h>
 #endif
 
-extern growing_string batched_out;
+// Every thread prints into its own buffer
+extern thread_local growing_string batched_out;
 
-inline void write_all(string_view s)
+// If set, full batches are passed to this function instead of being written
+// to standard output. Worker threads use it to hand their output over to be
+// written in order.
+extern thread_local std::function<void(string_view)> batched_flush_handler;
+
+// Batches are flushed when they get bigger than this. It's set to suit the
+// output sink.
+inline size_t batched_flush_size = 1000000;
+
+inline void write_all(string_view s, int fd = 1)
 {
-    int written = 0;
+    size_t written = 0;
     while (written < s.size())
     {
-        int w = write(1, s.data() + written, s.size() - written);
+        ssize_t w = write(fd, s.data() + written, s.size() - written);
         if (w == -1)
         {
+            if (errno == EINTR)
+            {
+                continue;
+            }
             cerr << "write failed\n";
             exit(EXIT_FAILURE);
         }
@@ -28,13 +45,25 @@ inline void write_all(string_view s)
 
 inline void batched_print_flush()
 {
-    write_all(batched_out.view());
+    if (batched_flush_handler)
+    {
+        batched_flush_handler(batched_out.view());
+    }
+    else if (active_output_writer)
+    {
+        active_output_writer->submit(batched_out);
+        return;
+    }
+    else
+    {
+        write_all(batched_out.view());
+    }
     batched_out.erase(0);
 }
 
 inline void batched_print_flush_if_needed()
 {
-    if (batched_out.size() > 1000000)
+    if (batched_out.size() > batched_flush_size)
     {
         batched_print_flush();
     }
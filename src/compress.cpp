@@ -0,0 +1,285 @@
+#include "compress.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+
+#ifdef ZLIB_FOUND
+#include <zlib.h>
+#endif
+#ifdef ZSTD_FOUND
+#include <zstd.h>
+#endif
+
+using std::cerr;
+
+[[noreturn]] static void compress_error(const char *message)
+{
+    cerr << "Failed to compress output: " << message << "\n";
+    exit(EXIT_FAILURE);
+}
+
+bool parse_output_compression(string_view name, compression &kind)
+{
+#ifdef ZLIB_FOUND
+    if (name == "gzip")
+    {
+        kind = compression::gzip;
+        return true;
+    }
+#endif
+#ifdef ZSTD_FOUND
+    if (name == "zstd")
+    {
+        kind = compression::zstd;
+        return true;
+    }
+#endif
+    return false;
+}
+
+#ifdef ZLIB_FOUND
+// Compresses in as a complete gzip member
+static void gzip_block(string_view in, int level, std::string &out)
+{
+    z_stream zs = {};
+    // 16 writes a gzip header instead of a zlib one
+    if (deflateInit2(&zs, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) !=
+        Z_OK)
+    {
+        compress_error("deflateInit2() failed");
+    }
+    out.resize(deflateBound(&zs, in.size()));
+    zs.next_in = (Bytef *)in.data();
+    zs.avail_in = in.size();
+    zs.next_out = (Bytef *)out.data();
+    zs.avail_out = out.size();
+    if (deflate(&zs, Z_FINISH) != Z_STREAM_END)
+    {
+        compress_error(zs.msg ? zs.msg : "deflate() failed");
+    }
+    out.resize(zs.total_out);
+    deflateEnd(&zs);
+}
+#endif
+
+#ifdef ZSTD_FOUND
+// Compresses in as a complete zstd frame with its content size
+static void zstd_block(string_view in, int level, std::string &out)
+{
+    // A context per worker thread keeps its tables between blocks
+    thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx *)> cctx(
+        ZSTD_createCCtx(), ZSTD_freeCCtx
+    );
+    out.resize(ZSTD_compressBound(in.size()));
+    size_t size = ZSTD_compressCCtx(
+        cctx.get(), out.data(), out.size(), in.data(), in.size(), level
+    );
+    if (ZSTD_isError(size))
+    {
+        compress_error(ZSTD_getErrorName(size));
+    }
+    out.resize(size);
+}
+#endif
+
+// Collects the output into blocks, compresses them on a thread pool and
+// writes the results in block order. Only a few blocks per thread are in
+// flight, so slow compression blocks the writer instead of using memory.
+struct compressing_sink : output_sink
+{
+    struct block
+    {
+        std::string in;
+        std::string out;
+        bool done = false;
+    };
+
+    // A compressed block whose memory the destination may still reference
+    struct written_block
+    {
+        std::shared_ptr<block> b;
+        // Bytes written up to the end of the block
+        size_t end;
+    };
+
+    std::unique_ptr<output_sink> destination;
+    compression kind;
+    int level;
+    size_t block_size;
+    size_t max_blocks;
+    std::string pending;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<block>> blocks;
+    bool wrote_block = false;
+    size_t total_written = 0;
+    std::deque<written_block> written;
+    // Last member, so the workers stop before the blocks are destroyed
+    thread_pool pool;
+
+    compressing_sink(
+        std::unique_ptr<output_sink> destination,
+        compression kind,
+        int level,
+        unsigned threads,
+        size_t block_size
+    )
+        : destination(std::move(destination)), kind(kind), level(level),
+          block_size(block_size), max_blocks(2 * std::max(threads, 1u) + 1),
+          pool(threads)
+    {
+    }
+
+    void compress(block &b)
+    {
+        switch (kind)
+        {
+#ifdef ZLIB_FOUND
+        case compression::gzip:
+            gzip_block(b.in, level, b.out);
+            break;
+#endif
+#ifdef ZSTD_FOUND
+        case compression::zstd:
+            zstd_block(b.in, level, b.out);
+            break;
+#endif
+        default:
+            compress_error("unsupported compression");
+        }
+        std::string().swap(b.in);
+    }
+
+    void submit_pending()
+    {
+        auto b = std::make_shared<block>();
+        b->in.swap(pending);
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            blocks.push_back(b);
+        }
+        pool.submit(
+            [this, b]()
+            {
+                compress(*b);
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    b->done = true;
+                }
+                cv.notify_all();
+            }
+        );
+        wrote_block = true;
+        write_done(blocks.size() >= max_blocks);
+    }
+
+    // Writes the compressed blocks at the front. If wait is set, waits for
+    // at least the first one.
+    void write_done(bool wait)
+    {
+        while (true)
+        {
+            std::shared_ptr<block> b;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (wait)
+                {
+                    cv.wait(
+                        lock,
+                        [&]() { return blocks.empty() || blocks.front()->done; }
+                    );
+                    wait = false;
+                }
+                if (blocks.empty() || !blocks.front()->done)
+                {
+                    return;
+                }
+                b = std::move(blocks.front());
+                blocks.pop_front();
+            }
+            destination->write(b->out);
+            total_written += b->out.size();
+            size_t distance = destination->reuse_distance();
+            if (distance > 0)
+            {
+                written.push_back({std::move(b), total_written});
+                while (written.front().end + distance <= total_written)
+                {
+                    written.pop_front();
+                }
+            }
+        }
+    }
+
+    void write(string_view s) override
+    {
+        pending.append(s);
+        if (pending.size() >= block_size)
+        {
+            submit_pending();
+        }
+    }
+
+    void finish() override
+    {
+        // Empty output still gets a member or frame, so it can be
+        // decompressed
+        if (!pending.empty() || !wrote_block)
+        {
+            submit_pending();
+        }
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (blocks.empty())
+                {
+                    break;
+                }
+            }
+            write_done(true);
+        }
+        destination->finish();
+        // As in output_writer, blocks the destination may still reference
+        // are left allocated, since freed memory could be overwritten before
+        // they are read.
+        for (auto &w : written)
+        {
+            new std::shared_ptr<block>(std::move(w.b));
+        }
+    }
+
+    size_t flush_size() const override { return block_size; }
+};
+
+std::unique_ptr<output_sink> make_compressing_sink(
+    std::unique_ptr<output_sink> destination,
+    compression kind,
+    std::optional<int> level,
+    unsigned threads,
+    size_t block_size
+)
+{
+    int default_level = 0;
+#ifdef ZLIB_FOUND
+    if (kind == compression::gzip)
+    {
+        default_level = Z_DEFAULT_COMPRESSION;
+    }
+#endif
+#ifdef ZSTD_FOUND
+    if (kind == compression::zstd)
+    {
+        default_level = ZSTD_CLEVEL_DEFAULT;
+    }
+#endif
+    return std::make_unique<compressing_sink>(
+        std::move(destination), kind, level.value_or(default_level), threads,
+        block_size
+    );
+}
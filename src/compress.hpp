@@ -0,0 +1,23 @@
+#pragma once
+#include "decompress.hpp"
+#include "output_sink.hpp"
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <string_view>
+using std::string_view;
+
+// Returns false if name isn't an output compression supported by this build.
+bool parse_output_compression(string_view name, compression &kind);
+
+// Returns a sink that compresses the output in blocks of block_size bytes on
+// threads worker threads and writes them to destination in order. Every
+// block is an independent gzip member or zstd frame, and concatenated they
+// make up a single valid file. level is the library default if not set.
+std::unique_ptr<output_sink> make_compressing_sink(
+    std::unique_ptr<output_sink> destination,
+    compression kind,
+    std::optional<int> level,
+    unsigned threads,
+    size_t block_size
+);
@@ -0,0 +1,516 @@
+#include "decompress.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <climits>
+#include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <BaseTsd.h>
+#include <io.h>
+typedef SSIZE_T ssize_t;
+#else
+#include <unistd.h>
+#endif
+
+#ifdef ZLIB_FOUND
+#include <zlib.h>
+#endif
+#ifdef LIBLZMA_FOUND
+#include <lzma.h>
+#endif
+#ifdef ZSTD_FOUND
+#include <zstd.h>
+#endif
+
+using std::cerr;
+
+[[noreturn]] static void decompress_error(const char *message)
+{
+    cerr << "Failed to decompress input: " << message << "\n";
+    exit(EXIT_FAILURE);
+}
+
+// Magic bytes at the start of each compressed format
+static const std::pair<string_view, compression> magics[] = {
+    {"\x1f\x8b", compression::gzip},
+    {"\x28\xb5\x2f\xfd", compression::zstd},
+    {string_view("\xfd" "7zXZ\x00", 6), compression::xz},
+};
+
+compression detect_compression(string_view head)
+{
+    for (auto &magic : magics)
+    {
+        if (head.starts_with(magic.first))
+        {
+            return magic.second;
+        }
+    }
+    return compression::none;
+}
+
+// Whether more bytes after head could still make it a magic number
+static bool could_become_magic(string_view head)
+{
+    for (auto &magic : magics)
+    {
+        if (magic.first.size() > head.size() && magic.first.starts_with(head))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Incremental decompressor of one compression format
+struct decoder
+{
+    // Set when the input seen so far ends at the end of a compressed stream
+    bool finished = false;
+
+    virtual ~decoder() = default;
+
+    // Decompresses from the start of in into out, removing the consumed bytes
+    // from in, and returns the number of bytes written. last tells that in
+    // holds all the remaining input.
+    virtual size_t
+    decode(string_view &in, char *out, size_t out_size, bool last) = 0;
+};
+
+#ifdef ZLIB_FOUND
+struct gzip_decoder : decoder
+{
+    z_stream zs = {};
+
+    gzip_decoder()
+    {
+        // 32 enables gzip header detection
+        if (inflateInit2(&zs, 15 + 32) != Z_OK)
+        {
+            decompress_error("inflateInit2() failed");
+        }
+    }
+
+    ~gzip_decoder() { inflateEnd(&zs); }
+
+    size_t decode(string_view &in, char *out, size_t out_size, bool) override
+    {
+        if (finished)
+        {
+            if (in.empty())
+            {
+                return 0;
+            }
+            // Concatenated gzip members make up a single gzip file
+            inflateReset(&zs);
+            finished = false;
+        }
+        zs.next_in = (Bytef *)in.data();
+        zs.avail_in = std::min(in.size(), (size_t)UINT_MAX);
+        zs.next_out = (Bytef *)out;
+        zs.avail_out = std::min(out_size, (size_t)UINT_MAX);
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        in.remove_prefix((const char *)zs.next_in - in.data());
+        if (ret == Z_STREAM_END)
+        {
+            finished = true;
+        }
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            decompress_error(zs.msg ? zs.msg : "corrupt gzip data");
+        }
+        return (char *)zs.next_out - out;
+    }
+};
+#endif
+
+#ifdef LIBLZMA_FOUND
+struct xz_decoder : decoder
+{
+    lzma_stream strm = LZMA_STREAM_INIT;
+
+    xz_decoder()
+    {
+        if (lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED) !=
+            LZMA_OK)
+        {
+            decompress_error("lzma_stream_decoder() failed");
+        }
+    }
+
+    ~xz_decoder() { lzma_end(&strm); }
+
+    size_t
+    decode(string_view &in, char *out, size_t out_size, bool last) override
+    {
+        strm.next_in = (const uint8_t *)in.data();
+        strm.avail_in = in.size();
+        strm.next_out = (uint8_t *)out;
+        strm.avail_out = out_size;
+        lzma_ret ret = lzma_code(&strm, last ? LZMA_FINISH : LZMA_RUN);
+        in.remove_prefix((const char *)strm.next_in - in.data());
+        if (ret == LZMA_STREAM_END)
+        {
+            finished = true;
+        }
+        else if (ret != LZMA_OK && ret != LZMA_BUF_ERROR)
+        {
+            decompress_error("corrupt xz data");
+        }
+        return (char *)strm.next_out - out;
+    }
+};
+#endif
+
+#ifdef ZSTD_FOUND
+struct zstd_decoder : decoder
+{
+    ZSTD_DCtx *dctx = ZSTD_createDCtx();
+
+    ~zstd_decoder() { ZSTD_freeDCtx(dctx); }
+
+    size_t decode(string_view &in, char *out, size_t out_size, bool) override
+    {
+        ZSTD_inBuffer input = {in.data(), in.size(), 0};
+        ZSTD_outBuffer output = {out, out_size, 0};
+        size_t ret = ZSTD_decompressStream(dctx, &output, &input);
+        if (ZSTD_isError(ret))
+        {
+            decompress_error(ZSTD_getErrorName(ret));
+        }
+        in.remove_prefix(input.pos);
+        // 0 means that a frame was fully decoded and flushed. Calls without
+        // progress already wait for the header of a next frame.
+        if (input.pos > 0 || output.pos > 0)
+        {
+            finished = ret == 0;
+        }
+        return output.pos;
+    }
+};
+#endif
+
+static std::unique_ptr<decoder> make_decoder(compression c)
+{
+    switch (c)
+    {
+    case compression::gzip:
+#ifdef ZLIB_FOUND
+        return std::make_unique<gzip_decoder>();
+#else
+        decompress_error("gzip support wasn't compiled in fastgron");
+#endif
+    case compression::xz:
+#ifdef LIBLZMA_FOUND
+        return std::make_unique<xz_decoder>();
+#else
+        decompress_error("xz support wasn't compiled in fastgron");
+#endif
+    case compression::zstd:
+#ifdef ZSTD_FOUND
+        return std::make_unique<zstd_decoder>();
+#else
+        decompress_error("zstd support wasn't compiled in fastgron");
+#endif
+    default:
+        return nullptr;
+    }
+}
+
+#ifdef ZSTD_FOUND
+// Decompresses zstd data made of several frames that all record their
+// decompressed size, one frame per thread. Returns false if the data doesn't
+// have that shape.
+static bool decompress_zstd_frames_parallel(string_view in, input_buffer &out)
+{
+    struct frame
+    {
+        size_t src_offset, src_size, dst_offset, dst_size;
+    };
+    std::vector<frame> frames;
+    size_t src_offset = 0, dst_offset = 0;
+    while (src_offset < in.size())
+    {
+        const char *src = in.data() + src_offset;
+        size_t src_size = ZSTD_findFrameCompressedSize(src, in.size() - src_offset);
+        unsigned long long dst_size =
+            ZSTD_getFrameContentSize(src, in.size() - src_offset);
+        if (ZSTD_isError(src_size) || dst_size == ZSTD_CONTENTSIZE_UNKNOWN ||
+            dst_size == ZSTD_CONTENTSIZE_ERROR)
+        {
+            return false;
+        }
+        frames.push_back({src_offset, src_size, dst_offset, dst_size});
+        src_offset += src_size;
+        dst_offset += dst_size;
+    }
+    if (frames.size() < 2)
+    {
+        return false;
+    }
+    out.allocate(dst_offset);
+    out.len = dst_offset;
+    std::atomic<size_t> next_frame = 0;
+    auto worker = [&]()
+    {
+        ZSTD_DCtx *dctx = ZSTD_createDCtx();
+        size_t i;
+        while ((i = next_frame++) < frames.size())
+        {
+            const frame &f = frames[i];
+            size_t ret = ZSTD_decompressDCtx(
+                dctx, out.data + f.dst_offset, f.dst_size,
+                in.data() + f.src_offset, f.src_size
+            );
+            if (ZSTD_isError(ret) || ret != f.dst_size)
+            {
+                decompress_error(
+                    ZSTD_isError(ret) ? ZSTD_getErrorName(ret)
+                                      : "zstd frame size mismatch"
+                );
+            }
+        }
+        ZSTD_freeDCtx(dctx);
+    };
+    size_t thread_count = std::min(
+        frames.size(), (size_t)std::max(1u, std::thread::hardware_concurrency())
+    );
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < thread_count; i++)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+    out.pad();
+    return true;
+}
+#endif
+
+void decompress_if_needed(input_buffer &buffer)
+{
+    compression c = detect_compression(buffer.str());
+    if (c == compression::none)
+    {
+        return;
+    }
+    input_buffer out;
+#ifdef ZSTD_FOUND
+    if (c == compression::zstd &&
+        decompress_zstd_frames_parallel(buffer.str(), out))
+    {
+        buffer = std::move(out);
+        return;
+    }
+#endif
+    std::unique_ptr<decoder> dec = make_decoder(c);
+    string_view in = buffer.str();
+    const size_t step = std::max(buffer.len, (size_t)1 << 20);
+    out.allocate(step * 4);
+    while (true)
+    {
+        if (out.capacity - simdjson::SIMDJSON_PADDING == out.len)
+        {
+            out.reserve_extra(step);
+        }
+        size_t in_size = in.size();
+        size_t written = dec->decode(
+            in, out.data + out.len,
+            out.capacity - simdjson::SIMDJSON_PADDING - out.len, true
+        );
+        out.len += written;
+        if (written == 0 && in.size() == in_size)
+        {
+            break;
+        }
+    }
+    if (!dec->finished)
+    {
+        decompress_error("unexpected end of compressed data");
+    }
+    out.pad();
+    buffer = std::move(out);
+}
+
+// Reads a file descriptor
+struct fd_source : input_source
+{
+    int fd;
+
+    fd_source(int fd) : fd(fd) {}
+
+    size_t read(char *buf, size_t n) override
+    {
+        while (true)
+        {
+            ssize_t r = ::read(fd, buf, n);
+            if (r >= 0)
+            {
+                return r;
+            }
+            if (errno != EINTR)
+            {
+                cerr << "Failed to read file\n";
+                exit(EXIT_FAILURE);
+            }
+        }
+    }
+};
+
+// Reads another source, returning the bytes peeked at first.
+struct peeking_source : input_source
+{
+    std::unique_ptr<input_source> source;
+    std::string peeked;
+    size_t peeked_pos = 0;
+
+    peeking_source(std::unique_ptr<input_source> source)
+        : source(std::move(source))
+    {
+    }
+
+    // Reads once, up to n bytes in all, to be returned again by the
+    // following reads. Returns false at the end of the source.
+    bool peek(size_t n)
+    {
+        size_t len = peeked.size();
+        peeked.resize(n);
+        size_t r = source->read(peeked.data() + len, n - len);
+        peeked.resize(len + r);
+        return r > 0;
+    }
+
+    size_t read(char *buf, size_t n) override
+    {
+        if (peeked_pos < peeked.size())
+        {
+            size_t len = std::min(n, peeked.size() - peeked_pos);
+            memcpy(buf, peeked.data() + peeked_pos, len);
+            peeked_pos += len;
+            return len;
+        }
+        return source->read(buf, n);
+    }
+};
+
+struct decompressing_source : input_source
+{
+    std::unique_ptr<input_source> compressed;
+    std::unique_ptr<decoder> dec;
+    std::vector<char> in_buffer = std::vector<char>(1 << 18);
+    string_view in;
+    bool eof = false;
+
+    decompressing_source(
+        std::unique_ptr<input_source> compressed, std::unique_ptr<decoder> dec
+    )
+        : compressed(std::move(compressed)), dec(std::move(dec))
+    {
+    }
+
+    size_t read(char *buf, size_t n) override
+    {
+        while (true)
+        {
+            if (in.empty() && !eof)
+            {
+                size_t r = compressed->read(in_buffer.data(), in_buffer.size());
+                in = string_view(in_buffer.data(), r);
+                eof = r == 0;
+            }
+            size_t in_size = in.size();
+            size_t written = dec->decode(in, buf, n, eof);
+            if (written > 0)
+            {
+                return written;
+            }
+            if (eof && in.size() == in_size)
+            {
+                if (!dec->finished)
+                {
+                    decompress_error("unexpected end of compressed data");
+                }
+                return 0;
+            }
+        }
+    }
+};
+
+// Reads another source on a separate thread, a few blocks ahead.
+struct background_source : input_source
+{
+    static const size_t block_size = 1 << 20;
+
+    std::unique_ptr<input_source> source;
+    queued_source queue;
+    std::thread thread;
+
+    background_source(std::unique_ptr<input_source> source)
+        : source(std::move(source))
+    {
+        thread = std::thread([this]() { produce(); });
+    }
+
+    ~background_source()
+    {
+        queue.stop();
+        thread.join();
+    }
+
+    void produce()
+    {
+        while (true)
+        {
+            std::vector<char> block(block_size);
+            size_t len = source->read(block.data(), block.size());
+            if (len == 0)
+            {
+                queue.close();
+                return;
+            }
+            block.resize(len);
+            if (!queue.push(std::move(block)))
+            {
+                return;
+            }
+        }
+    }
+
+    size_t read(char *buf, size_t n) override { return queue.read(buf, n); }
+};
+
+std::unique_ptr<input_source>
+open_input_source(std::unique_ptr<input_source> source, bool background)
+{
+    auto plain = std::make_unique<peeking_source>(std::move(source));
+    // A pipe may only have a short first record yet, so reading stops as
+    // soon as the bytes read can't start a magic number
+    while (could_become_magic(plain->peeked) && plain->peek(6))
+    {
+    }
+    compression c = detect_compression(plain->peeked);
+    if (c == compression::none)
+    {
+        return plain;
+    }
+    std::unique_ptr<input_source> decompressed =
+        std::make_unique<decompressing_source>(std::move(plain), make_decoder(c));
+    if (background)
+    {
+        decompressed =
+            std::make_unique<background_source>(std::move(decompressed));
+    }
+    return decompressed;
+}
+
+std::unique_ptr<input_source> open_input_source(int fd, bool background)
+{
+    return open_input_source(std::make_unique<fd_source>(fd), background);
+}
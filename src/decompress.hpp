@@ -0,0 +1,32 @@
+#pragma once
+#include "input_buffer.hpp"
+#include "input_source.hpp"
+#include <cstddef>
+#include <memory>
+#include <string_view>
+using std::string_view;
+
+enum class compression
+{
+    none,
+    gzip,
+    zstd,
+    xz
+};
+
+// Recognizes compressed data by the magic bytes at its start.
+compression detect_compression(string_view head);
+
+// Replaces the content of buffer with its decompressed content if it's
+// compressed. Multi-frame zstd data with known frame sizes is decompressed
+// in parallel.
+void decompress_if_needed(input_buffer &buffer);
+
+// Returns a source reading fd, which decompresses the data if it starts with
+// a gzip, zstd or xz header. If background is set, decompression runs on a
+// separate thread, overlapping with the processing of its output.
+std::unique_ptr<input_source> open_input_source(int fd, bool background);
+
+// Same for input read from another source
+std::unique_ptr<input_source>
+open_input_source(std::unique_ptr<input_source> source, bool background);
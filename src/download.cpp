@@ -0,0 +1,349 @@
+#include "download.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#ifdef CURL_FOUND
+#include <curl/curl.h>
+#endif
+
+using std::cerr;
+
+#ifdef CURL_FOUND
+
+// Custom headers in the form curl takes them
+struct header_list
+{
+    struct curl_slist *list = NULL;
+
+    header_list(const download_options &opts)
+    {
+        for (const auto &header : opts.headers)
+        {
+            cerr << "Adding header: " << header << "\n";
+            list = curl_slist_append(list, header.c_str());
+        }
+    }
+    ~header_list() { curl_slist_free_all(list); }
+};
+
+// curl_easy_init isn't thread safe before global initialization
+static void init_curl()
+{
+    static std::once_flag init_flag;
+    std::call_once(init_flag, []() { curl_global_init(CURL_GLOBAL_DEFAULT); });
+}
+
+// Creates a handle for downloading url, which passes the body to
+// callback(data, size, 1, userdata) as it arrives.
+static CURL *make_handle(
+    const std::string &url,
+    const download_options &opts,
+    const header_list &headers,
+    curl_write_callback callback,
+    void *userdata
+)
+{
+    init_curl();
+    CURL *curl = curl_easy_init();
+    if (curl == nullptr)
+    {
+        cerr << "Failed to initialize CURL\n";
+        exit(EXIT_FAILURE);
+    }
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, userdata);
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, opts.user_agent.c_str());
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers.list);
+    // Error pages aren't JSON
+    curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+    // Ask for every encoding that curl can decode
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "");
+    return curl;
+}
+
+[[noreturn]] static void download_error(const std::string &url, CURLcode res)
+{
+    cerr << "Error when downloading " << url << ": " << curl_easy_strerror(res)
+         << "\n";
+    exit(EXIT_FAILURE);
+}
+
+// Body of a download that is collected in a padded buffer
+struct body_buffer
+{
+    CURL *curl = nullptr;
+    input_buffer buffer;
+    bool sized = false;
+
+    static size_t write(char *ptr, size_t size, size_t nmemb, void *userdata)
+    {
+        auto &body = *static_cast<body_buffer *>(userdata);
+        size_t len = size * nmemb;
+        if (!body.sized)
+        {
+            // The headers are complete by the time the body arrives. With a
+            // compressed transfer the length is only a lower bound.
+            curl_off_t content_length = -1;
+            curl_easy_getinfo(
+                body.curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &content_length
+            );
+            if (content_length > 0)
+            {
+                body.buffer.reserve_extra(content_length);
+            }
+            body.sized = true;
+        }
+        body.buffer.reserve_extra(len);
+        memcpy(body.buffer.data + body.buffer.len, ptr, len);
+        body.buffer.len += len;
+        return len;
+    }
+
+    // Returns the padded body.
+    input_buffer finish()
+    {
+        if (buffer.data == nullptr)
+        {
+            buffer.allocate(0);
+        }
+        buffer.pad();
+        return std::move(buffer);
+    }
+};
+
+input_buffer download(const std::string &url, const download_options &opts)
+{
+    header_list headers(opts);
+    body_buffer body;
+    body.curl = make_handle(url, opts, headers, body_buffer::write, &body);
+    CURLcode res = curl_easy_perform(body.curl);
+    if (res != CURLE_OK)
+    {
+        download_error(url, res);
+    }
+    curl_easy_cleanup(body.curl);
+    return body.finish();
+}
+
+// Source that runs the download on its own thread, queueing the body for the
+// reader.
+struct url_source : input_source
+{
+    std::string url;
+    download_options opts;
+    queued_source queue;
+    bool stopped = false;
+    std::thread thread;
+
+    url_source(const std::string &url, const download_options &opts)
+        : url(url), opts(opts)
+    {
+        thread = std::thread([this]() { run(); });
+    }
+
+    ~url_source()
+    {
+        queue.stop();
+        thread.join();
+    }
+
+    static size_t write(char *ptr, size_t size, size_t nmemb, void *userdata)
+    {
+        auto &source = *static_cast<url_source *>(userdata);
+        if (!source.queue.push(std::vector<char>(ptr, ptr + size * nmemb)))
+        {
+            // Aborts the transfer
+            source.stopped = true;
+            return 0;
+        }
+        return size * nmemb;
+    }
+
+    void run()
+    {
+        header_list headers(opts);
+        CURL *curl = make_handle(url, opts, headers, write, this);
+        CURLcode res = curl_easy_perform(curl);
+        if (res != CURLE_OK && !stopped)
+        {
+            download_error(url, res);
+        }
+        curl_easy_cleanup(curl);
+        queue.close();
+    }
+
+    size_t read(char *buf, size_t n) override { return queue.read(buf, n); }
+};
+
+std::unique_ptr<input_source>
+open_url_source(const std::string &url, const download_options &opts)
+{
+    return std::make_unique<url_source>(url, opts);
+}
+
+struct url_fetcher::state
+{
+    struct transfer
+    {
+        body_buffer body;
+        bool done = false;
+        CURLcode result = CURLE_OK;
+    };
+
+    std::vector<std::string> urls;
+    download_options opts;
+    size_t max_ahead;
+    CURLM *multi;
+    std::vector<transfer> transfers;
+    std::mutex mutex;
+    std::condition_variable cv;
+    // One past the highest index that was taken
+    size_t taken = 0;
+    bool stopping = false;
+    std::thread thread;
+
+    void run()
+    {
+        header_list headers(opts);
+        size_t next = 0;
+        int running = 0;
+        while (true)
+        {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (stopping)
+                {
+                    break;
+                }
+                // Start the transfers that the reader will need soon
+                for (; next < urls.size() && next < taken + max_ahead; next++)
+                {
+                    body_buffer &body = transfers[next].body;
+                    body.curl = make_handle(
+                        urls[next], opts, headers, body_buffer::write, &body
+                    );
+                    curl_easy_setopt(body.curl, CURLOPT_PRIVATE, (void *)next);
+                    curl_multi_add_handle(multi, body.curl);
+                }
+            }
+            curl_multi_perform(multi, &running);
+            int queued;
+            while (CURLMsg *msg = curl_multi_info_read(multi, &queued))
+            {
+                if (msg->msg != CURLMSG_DONE)
+                {
+                    continue;
+                }
+                void *index;
+                curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &index);
+                transfer &t = transfers[(size_t)index];
+                curl_multi_remove_handle(multi, msg->easy_handle);
+                curl_easy_cleanup(msg->easy_handle);
+                std::lock_guard<std::mutex> lock(mutex);
+                t.result = msg->data.result;
+                t.done = true;
+                cv.notify_all();
+            }
+            if (running == 0 && next == urls.size())
+            {
+                break;
+            }
+            curl_multi_poll(multi, NULL, 0, 1000, NULL);
+        }
+        // Transfers still running when the reader stops are abandoned
+        for (auto &t : transfers)
+        {
+            if (t.body.curl != nullptr && !t.done)
+            {
+                curl_multi_remove_handle(multi, t.body.curl);
+                curl_easy_cleanup(t.body.curl);
+            }
+        }
+    }
+};
+
+url_fetcher::url_fetcher(
+    const std::vector<std::string> &urls,
+    const download_options &opts,
+    size_t max_ahead
+)
+    : s(std::make_unique<state>())
+{
+    init_curl();
+    s->urls = urls;
+    s->opts = opts;
+    s->max_ahead = max_ahead;
+    s->transfers.resize(urls.size());
+    // Connections are kept in the multi handle and reused by later transfers
+    s->multi = curl_multi_init();
+    curl_multi_setopt(s->multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long)max_ahead);
+    s->thread = std::thread([this]() { s->run(); });
+}
+
+url_fetcher::~url_fetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(s->mutex);
+        s->stopping = true;
+    }
+    curl_multi_wakeup(s->multi);
+    s->thread.join();
+    curl_multi_cleanup(s->multi);
+}
+
+input_buffer url_fetcher::take(size_t i)
+{
+    std::unique_lock<std::mutex> lock(s->mutex);
+    if (i + 1 > s->taken)
+    {
+        s->taken = i + 1;
+        curl_multi_wakeup(s->multi);
+    }
+    auto &t = s->transfers[i];
+    s->cv.wait(lock, [&]() { return t.done; });
+    if (t.result != CURLE_OK)
+    {
+        download_error(s->urls[i], t.result);
+    }
+    return t.body.finish();
+}
+
+#else
+
+[[noreturn]] static void no_curl()
+{
+    cerr << "CURL wasn't compiled in fastgron\n";
+    exit(EXIT_FAILURE);
+}
+
+input_buffer download(const std::string &, const download_options &)
+{
+    no_curl();
+}
+
+std::unique_ptr<input_source>
+open_url_source(const std::string &, const download_options &)
+{
+    no_curl();
+}
+
+struct url_fetcher::state
+{
+};
+
+url_fetcher::url_fetcher(
+    const std::vector<std::string> &, const download_options &, size_t
+)
+{
+    no_curl();
+}
+
+url_fetcher::~url_fetcher() {}
+
+input_buffer url_fetcher::take(size_t) { no_curl(); }
+
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+#include "input_buffer.hpp"
+#include "input_source.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+struct download_options
+{
+    std::string user_agent;
+    std::vector<std::string> headers;
+};
+
+// Downloads url into a padded buffer, which is sized from Content-Length when
+// the server sends it.
+input_buffer download(const std::string &url, const download_options &opts);
+
+// Returns a source of the body of url, which is downloaded on a separate
+// thread while the source is read.
+std::unique_ptr<input_source>
+open_url_source(const std::string &url, const download_options &opts);
+
+// Downloads a list of URLs concurrently on a separate thread, reusing
+// connections between the requests. At most max_ahead transfers are started
+// past the last body that was taken.
+class url_fetcher
+{
+  public:
+    url_fetcher(
+        const std::vector<std::string> &urls,
+        const download_options &opts,
+        size_t max_ahead
+    );
+    ~url_fetcher();
+
+    // Waits for the body of urls[i] and returns it. Each body can be taken
+    // once.
+    input_buffer take(size_t i);
+
+  private:
+    struct state;
+    std::unique_ptr<state> s;
+};
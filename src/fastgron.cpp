@@ -1,11 +1,15 @@
 #include "simdjson.h"
 #include <algorithm>
+#include <condition_variable>
 #include <cstring> // for strcmp
 #include <functional>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <optional>
 #include <string>
 #include <string_view>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <variant>
 #include <vector>
@@ -22,42 +26,77 @@ typedef SSIZE_T ssize_t;
 #include <unistd.h>
 #endif
 
-#ifdef CURL_FOUND
-#include <curl/curl.h>
-bool curl_found = true;
-#else
-bool curl_found = false;
-#endif
-
 using namespace simdjson;
 using namespace std;
 
 string out;
 
 #include "batched_print.hpp"
+#include "compress.hpp"
+#include "decompress.hpp"
+#include "download.hpp"
 #include "growing_string.hpp"
+#include "input_buffer.hpp"
+#include "json_scanner.hpp"
 #include "jsonutils.hpp"
+#include "output_sink.hpp"
+#include "output_writer.hpp"
+#include "parallel.hpp"
 #include "parse_gron.hpp"
+#include "print_csv.hpp"
 #include "print_filtered_path.hpp"
 #include "print_gron.hpp"
 #include "print_json.hpp"
+#include "print_split.hpp"
+#include "print_windowed.hpp"
+#include "stream_reader.hpp"
+
+// Input file name or URL, with the root given to it by --root
+struct input_file
+{
+    std::string name;
+    std::optional<std::string> root;
+};
 
 // Parse command-line options
 struct options
 {
     std::string filename;
+    std::vector<input_file> inputs;
+    // --root that wasn't followed by an input
+    std::optional<std::string> pending_root;
+    unsigned threads;
+    // Size of the pieces a single document is split into for -j, chosen
+    // from the document size if 0
+    size_t split_size;
     bool stream;
     bool help;
     bool version;
     bool ungron;
+    load_method load;
+    bool windowed;
+    bool output_json;
+    bool output_ndjson;
+    // Field delimiter of --output-csv and --output-tsv, 0 if not set
+    char output_csv;
+    // Number of records the CSV columns are inferred from
+    size_t infer_columns;
     std::string filtered_path;
-    std::vector<std::string> headers; // for storing headers
+    // Output file, standard output if empty
+    std::string output;
+    sink_kind sink;
+    // Overrides the flush size chosen for the sink if not 0
+    size_t flush_size;
+    // Compression of the output, and its level if not the default
+    compression compress;
+    std::optional<int> compress_level;
+    // Set by --color and --no-color, otherwise color is used on terminals
+    std::optional<bool> color;
+    download_options download;
 };
 
 string root = "json";
 
-string user_agent = "fastgron";
-
 bool is_url(string_view url)
 {
     if (url.starts_with("http://") || url.starts_with("https://"))
@@ -87,12 +126,17 @@ void print_help()
 {
     cerr <<
 #ifdef CURL_FOUND
-        "Usage: fastgron [OPTIONS] [FILE | URL] [.path]\n\n"
+        "Usage: fastgron [OPTIONS] [FILE | URL]... [.path]\n\n"
 #else
-        "Usage: fastgron [OPTIONS] [FILE] [.path]\n\n"
+        "Usage: fastgron [OPTIONS] [FILE]... [.path]\n\n"
 #endif
         "positional arguments:\n"
-        "  FILE           file name (or '-' for standard input)\n\n"
+        "  FILE           file name (or '-' for standard input)\n"
+        "                 Multiple files are converted in parallel, each "
+        "under\n"
+        "                 its own root: json[\"FILE\"] or the --root given "
+        "right\n"
+        "                 before it\n\n"
         "options:\n"
         "  -h, --help     show this help message and exit\n"
         "  -V, --version  show version information and exit\n"
@@ -107,7 +151,19 @@ void print_help()
         "  --user-agent   set user agent\n"
         "  --header Name:value       set custom HTTP header, can be used "
         "multiple times\n"
+        "  --url-list FILE  read URLs to convert from FILE, one per line; "
+        "they\n"
+        "                 are downloaded concurrently, reusing connections\n"
         "  -u, --ungron   ungron: convert gron output back to JSON\n"
+        "  --no-mmap      read input files into memory instead of mapping "
+        "them\n"
+        "  --io-uring     read input files with io_uring, keeping several "
+        "reads\n"
+        "                 in flight (falls back to read() if unavailable)\n"
+        "  -W, --windowed  read and print the elements of a top level array\n"
+        "                 (or of the arrays in a top level object) one by "
+        "one,\n"
+        "                 using constant memory for arbitrarily big input\n"
         "  -p, -path      filter path, for example .#.3.population or "
         "cities.#.population\n"
         "                 -p is optional if path starts with . and file with "
@@ -116,11 +172,51 @@ void print_help()
         ".{id,users[1:-3:2].{name,address}}\n"
         "                 [[3]] is an index accessor without outputting on the "
         "path.\n"
+        "  --output-json  print what the path selects as JSON instead of "
+        "gron,\n"
+        "                 copying the selected values from the input\n"
+        "  --output-ndjson  print every value the path selects as compact "
+        "JSON\n"
+        "                 on its own line, also in stream mode\n"
+        "  --output-csv, --output-tsv  print the records the path selects "
+        "as\n"
+        "                 CSV or TSV rows; a path ending in .{a,b} picks the\n"
+        "                 columns, otherwise they are the keys of the first\n"
+        "                 records, also in stream mode\n"
+        "  --infer-columns N  number of records to take the CSV columns "
+        "from,\n"
+        "                 100 by default\n"
         "  --no-indent   don't indent output\n"
         "  --no-newline  no newline inside JSON output\n"
         "  --root        root path, default is json\n"
+        "  -j, --threads N  number of threads to use for multiple files, a\n"
+        "                 large document or stream and --compress\n"
+        "  --split-size N  bytes of a large document or stream each thread\n"
+        "                 prints at a time, by default chosen from its size\n"
         "  --semicolon   add semicolon to the end of each line\n"
+        "  --prefix-delta  print each line as the number of bytes it shares\n"
+        "                with the previous line and the rest of it; --ungron\n"
+        "                reads this format too\n"
+        "  --skip-initializations  don't print the = {} and = [] lines\n"
+        "  --values      print only the values of the leaves\n"
+        "  --paths       print only the paths\n"
         "  --no-spaces   don't add spaces around =\n"
+        "  -o, --output FILE  write the output to FILE\n"
+        "  --sink KIND   how output is written: fd (default), vmsplice (pass "
+        "the\n"
+        "                pages to a pipe, only for readers that read() it), "
+        "mmap\n"
+        "                (map the output file), memory (write all at the end) "
+        "or\n"
+        "                null (discard, print the size to stderr)\n"
+        "  --flush-size N  bytes buffered before writing, by default chosen\n"
+        "                for the output: small for terminals, the pipe size "
+        "for\n"
+        "                pipes, large for files\n"
+        "  --compress gzip|zstd  compress the output on -j threads, in\n"
+        "                blocks of 1MB or the flush size\n"
+        "  --compress-level N  compression level, the library default if "
+        "not set\n"
         "  -c, --color   colorize output\n"
         "  --no-color    don't colorize output\n"
         "\nHome page with more information: "
@@ -134,115 +230,42 @@ void print_version()
     cerr << "fastgron version " << FASTGRON_VERSION << "\n";
 }
 
-std::string readFileIntoString(int fd)
-{
-    std::vector<char> buffer(1000000);
-    std::string content;
-
-    ssize_t bytesRead = 0;
-    while ((bytesRead = read(fd, buffer.data(), buffer.size())) > 0)
-    {
-        content.append(buffer.data(), bytesRead);
-    }
-
-    if (bytesRead == -1)
-    {
-        cerr << "Failed to read file\n";
-        return "";
-    }
-
-    close(fd);
-    return content;
-}
-
-// Set up CURL
-
-struct string2
-{
-    char *ptr;
-    size_t len;
-};
-
-void init_string(struct string2 *s)
-{
-    s->len = 0;
-    s->ptr = (char *)malloc(s->len + 1);
-    if (s->ptr == NULL)
-    {
-        cerr << "malloc() failed\n";
-        exit(EXIT_FAILURE);
-    }
-    s->ptr[0] = '\0';
-}
-
-size_t writefunc(void *ptr, size_t size, size_t nmemb, struct string2 *s)
-{
-    size_t new_len = s->len + size * nmemb;
-    s->ptr = (char *)realloc(s->ptr, new_len + 1);
-    if (s->ptr == NULL)
-    {
-        cerr << "realloc() failed\n";
-        exit(EXIT_FAILURE);
-    }
-    memcpy(s->ptr + s->len, ptr, size * nmemb);
-    s->ptr[new_len] = '\0';
-    s->len = new_len;
-
-    return size * nmemb;
-}
+unsigned flags = SPACES | INDENT | NEWLINE;
+vector<string> filters;
 
-std::string download(options opts)
+// Adds the URLs listed in a file (or - for standard input) as inputs, one per
+// line. Empty lines and lines starting with # are skipped.
+void add_url_list(options &opts, const string &filename)
 {
-
-#ifdef CURL_FOUND
-    std::string url = opts.filename;
-    CURL *curl;
-    CURLcode res;
-    struct curl_slist *headers = NULL;
-
-    curl = curl_easy_init();
-    string r;
-    if (curl)
+    input_buffer list = filename == "-" ? read_fd(0) : load_file(filename, load_method::read);
+    string_view rest = list.str();
+    while (!rest.empty())
     {
-        for (const auto &header : opts.headers)
+        size_t end = rest.find('\n');
+        string_view line = rest.substr(0, end);
+        rest = end == string_view::npos ? "" : rest.substr(end + 1);
+        while (!line.empty() && isspace((unsigned char)line.back()))
         {
-            cout << "Adding header: " << header << "\n";
-            headers = curl_slist_append(headers, header.c_str());
+            line.remove_suffix(1);
         }
-
-        struct string2 s;
-        init_string(&s);
-
-        curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writefunc);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &s);
-        curl_easy_setopt(curl, CURLOPT_USERAGENT, user_agent.c_str());
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-
-        res = curl_easy_perform(curl);
-
-        r = string_view(s.ptr, s.len);
-        if (res != CURLE_OK)
+        while (!line.empty() && isspace((unsigned char)line.front()))
+        {
+            line.remove_prefix(1);
+        }
+        if (line.empty() || line[0] == '#')
         {
-            const char *curl_err_msg = curl_easy_strerror(res);
-            cerr << "Error when downloading data: " << string(curl_err_msg)
-                 << "\n";
+            continue;
+        }
+        if (!is_url(line))
+        {
+            cerr << "Not a URL in " << filename << ": " << line << "\n";
             exit(EXIT_FAILURE);
         }
-        free(s.ptr);
-
-        /* always cleanup */
-        curl_slist_free_all(headers);
-        curl_easy_cleanup(curl);
+        opts.filename = line;
+        opts.inputs.push_back({string(line), opts.pending_root});
+        opts.pending_root.reset();
     }
-    return r;
-#else
-    cerr << "CURL wasn't compiled in fastgron\n";
-    exit(EXIT_FAILURE);
-#endif
 }
-unsigned flags = SPACES | INDENT | NEWLINE;
-vector<string> filters;
 
 options parse_options(int argc, char *argv[])
 {
@@ -251,6 +274,18 @@ options parse_options(int argc, char *argv[])
     opts.help = false;
     opts.version = false;
     opts.ungron = false;
+    opts.load = load_method::mmap;
+    opts.sink = sink_kind::fd;
+    opts.flush_size = 0;
+    opts.compress = compression::none;
+    opts.windowed = false;
+    opts.output_json = false;
+    opts.output_ndjson = false;
+    opts.output_csv = 0;
+    opts.infer_columns = 100;
+    opts.threads = default_thread_count();
+    opts.split_size = 0;
+    opts.download.user_agent = "fastgron";
 
     if (argc == 1 && isatty(0))
     {
@@ -288,6 +323,44 @@ options parse_options(int argc, char *argv[])
         {
             opts.ungron = true;
         }
+        else if (strcmp(argv[i], "--no-mmap") == 0)
+        {
+            opts.load = load_method::read;
+        }
+        else if (strcmp(argv[i], "--io-uring") == 0)
+        {
+            opts.load = load_method::io_uring;
+        }
+        else if (strcmp(argv[i], "-W") == 0 ||
+                 strcmp(argv[i], "--windowed") == 0)
+        {
+            opts.windowed = true;
+        }
+        else if (strcmp(argv[i], "--output-json") == 0)
+        {
+            opts.output_json = true;
+        }
+        else if (strcmp(argv[i], "--output-ndjson") == 0)
+        {
+            opts.output_ndjson = true;
+        }
+        else if (strcmp(argv[i], "--output-csv") == 0)
+        {
+            opts.output_csv = ',';
+        }
+        else if (strcmp(argv[i], "--output-tsv") == 0)
+        {
+            opts.output_csv = '\t';
+        }
+        else if (strcmp(argv[i], "--infer-columns") == 0)
+        {
+            if (i + 1 >= argc || atol(argv[i + 1]) <= 0)
+            {
+                cerr << "Missing or invalid argument for --infer-columns\n";
+                exit(EXIT_FAILURE);
+            }
+            opts.infer_columns = atol(argv[++i]);
+        }
         else if (strcmp(argv[i], "-F") == 0 ||
                  strcmp(argv[i], "--fixed-string") == 0)
         {
@@ -318,7 +391,7 @@ options parse_options(int argc, char *argv[])
                 cerr << "Missing argument for --user-agent\n";
                 exit(EXIT_FAILURE);
             }
-            user_agent = argv[++i];
+            opts.download.user_agent = argv[++i];
         }
         else if (strcmp(argv[i], "--no-indent") == 0)
         {
@@ -345,6 +418,26 @@ options parse_options(int argc, char *argv[])
                 exit(EXIT_FAILURE);
             }
             root = argv[++i];
+            opts.pending_root = root;
+        }
+        else if (strcmp(argv[i], "-j") == 0 ||
+                 strcmp(argv[i], "--threads") == 0)
+        {
+            if (i + 1 >= argc || atoi(argv[i + 1]) <= 0)
+            {
+                cerr << "Missing or invalid argument for --threads\n";
+                exit(EXIT_FAILURE);
+            }
+            opts.threads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--url-list") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                cerr << "Missing argument for --url-list\n";
+                exit(EXIT_FAILURE);
+            }
+            add_url_list(opts, argv[++i]);
         }
         else if (strcmp(argv[i], "--header") == 0)
         {
@@ -353,24 +446,96 @@ options parse_options(int argc, char *argv[])
                 cerr << "Missing argument for --header\n";
                 exit(EXIT_FAILURE);
             }
-            opts.headers.push_back(argv[++i]);
+            opts.download.headers.push_back(argv[++i]);
         }
 
         else if (strcmp(argv[i], "--semicolon") == 0)
         {
             flags |= SEMICOLON;
         }
+        else if (strcmp(argv[i], "--prefix-delta") == 0)
+        {
+            flags |= PREFIX_DELTA;
+        }
+        else if (strcmp(argv[i], "--skip-initializations") == 0)
+        {
+            flags |= SKIP_INITIALIZERS;
+        }
+        else if (strcmp(argv[i], "--values") == 0)
+        {
+            flags |= VALUES_ONLY;
+        }
+        else if (strcmp(argv[i], "--paths") == 0)
+        {
+            flags |= PATHS_ONLY;
+        }
         else if (strcmp(argv[i], "--no-spaces") == 0)
         {
             flags &= ~SPACES;
         }
         else if (strcmp(argv[i], "--color") == 0 || strcmp(argv[i], "-c") == 0)
         {
-            flags |= COLOR;
+            opts.color = true;
         }
         else if (strcmp(argv[i], "--no-color") == 0)
         {
-            flags &= ~COLOR;
+            opts.color = false;
+        }
+        else if (strcmp(argv[i], "-o") == 0 ||
+                 strcmp(argv[i], "--output") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                cerr << "Missing argument for --output\n";
+                exit(EXIT_FAILURE);
+            }
+            opts.output = argv[++i];
+        }
+        else if (strcmp(argv[i], "--sink") == 0)
+        {
+            if (i + 1 >= argc || !parse_sink_kind(argv[i + 1], opts.sink))
+            {
+                cerr << "Missing or invalid argument for --sink\n";
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--split-size") == 0)
+        {
+            if (i + 1 >= argc || atol(argv[i + 1]) <= 0)
+            {
+                cerr << "Missing or invalid argument for --split-size\n";
+                exit(EXIT_FAILURE);
+            }
+            opts.split_size = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--flush-size") == 0)
+        {
+            if (i + 1 >= argc || atol(argv[i + 1]) <= 0)
+            {
+                cerr << "Missing or invalid argument for --flush-size\n";
+                exit(EXIT_FAILURE);
+            }
+            opts.flush_size = atol(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--compress") == 0)
+        {
+            if (i + 1 >= argc ||
+                !parse_output_compression(argv[i + 1], opts.compress))
+            {
+                cerr << "Missing or unsupported argument for --compress\n";
+                exit(EXIT_FAILURE);
+            }
+            i++;
+        }
+        else if (strcmp(argv[i], "--compress-level") == 0)
+        {
+            if (i + 1 >= argc)
+            {
+                cerr << "Missing argument for --compress-level\n";
+                exit(EXIT_FAILURE);
+            }
+            opts.compress_level = atoi(argv[++i]);
         }
         else if (argv[i][0] == '-' && argv[i] != string("-"))
         {
@@ -397,6 +562,8 @@ options parse_options(int argc, char *argv[])
             else
             {
                 opts.filename = argv[i];
+                opts.inputs.push_back({argv[i], opts.pending_root});
+                opts.pending_root.reset();
             }
         }
     }
@@ -404,15 +571,445 @@ options parse_options(int argc, char *argv[])
     return opts;
 }
 
-int main(int argc, char *argv[])
+// Opens the input file, - or an empty name meaning standard input
+int open_input(const string &filename)
 {
-    if (isatty(1))
+    if (filename.empty() || filename == "-")
     {
-        flags |= COLOR;
+        return 0;
+    }
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        cerr << "Failed to open file: " << filename << "\n";
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+// Returns true if fd is a regular file that isn't compressed, so it can be
+// loaded in one piece cheaply.
+bool is_uncompressed_regular_file(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+    char head[6];
+    ssize_t len = pread(fd, head, sizeof(head), lseek(fd, 0, SEEK_CUR));
+    return len < 0 ||
+           detect_compression(string_view(head, len)) == compression::none;
+}
+
+// Path expression of --output-ndjson, parsed once for all documents
+ValueAccessor ndjson_path;
+
+// Writer of --output-csv and --output-tsv, kept for all documents
+std::unique_ptr<csv_writer> csv_output;
+
+// Returns the path expression given with --path, without the root it may
+// start with.
+string path_expression(const string &filtered_path)
+{
+    if (filtered_path.starts_with(root))
+    {
+        return filtered_path.substr(root.size());
+    }
+    if (filtered_path.empty() || filtered_path[0] == '.' ||
+        filtered_path[0] == '[')
+    {
+        return filtered_path;
+    }
+    return "." + filtered_path;
+}
+
+// Prints the initialization of the root array of a stream
+void print_stream_header(const string &root)
+{
+    if (flags & (SKIP_INITIALIZERS | VALUES_ONLY))
+    {
+        return;
+    }
+    gprint(
+        (flags & PATHS_ONLY) ? root + "\n" : root + " = [];\n", batched_out,
+        flags, filters
+    );
+}
+
+// Prints the documents in json as elements of the root array, numbering them
+// from index.
+void print_documents(
+    ondemand::parser &parser,
+    padded_string_view json,
+    int &index,
+    const string &root,
+    const options &opts
+)
+{
+    ondemand::document_stream docs = parser.iterate_many(
+        json.data(), json.size(), ondemand::DEFAULT_BATCH_SIZE
+    );
+    for (auto doc : docs)
+    {
+        if (opts.output_ndjson)
+        {
+            print_filtered_path_ndjson(ndjson_path, doc.value());
+            continue;
+        }
+        if (csv_output)
+        {
+            csv_output->print_document(doc.value());
+            continue;
+        }
+        growing_string path = growing_string(root);
+        path.append("[").append(to_string(index++)).append("]");
+        print_gron_document(doc.value(), path, batched_out, flags, filters);
+    }
+}
+
+// Loads a file, URL or standard input in one piece
+input_buffer load_input(const string &filename, const options &opts)
+{
+    input_buffer json;
+    // Check if filename is provided
+    if (filename.empty() || filename == "-")
+    {
+        // Load string from stdin
+        json = read_fd(0);
+    }
+    else if (is_url(filename))
+    {
+        json = download(filename, opts.download);
+    }
+    else
+    {
+        json = load_file(filename, opts.load);
+    }
+    decompress_if_needed(json);
+    return json;
+}
+
+// Size of the pieces an input of size bytes is printed in on threads
+size_t split_piece_size(size_t size, const options &opts)
+{
+    // By default a few pieces per thread, so that they can be balanced, but
+    // not too big ones, since the output of the pieces waiting for the
+    // previous ones is held in memory
+    if (opts.split_size)
+    {
+        return opts.split_size;
+    }
+    return std::clamp(
+        size / (4 * opts.threads), size_t(1) << 18, size_t(1) << 21
+    );
+}
+
+// Prints doc on threads if it's large enough to be worth it. Returns false
+// if it wasn't printed.
+bool split_document(
+    ondemand::document &doc,
+    input_buffer &json,
+    growing_string &path,
+    const options &opts
+)
+{
+    size_t size = json.view().size();
+    size_t piece_size = split_piece_size(size, opts);
+    if (opts.threads < 2 || size <= 2 * piece_size)
+    {
+        return false;
+    }
+    return print_gron_split(
+        doc, json.view(), path, flags, filters, opts.threads, piece_size
+    );
+}
+
+// Number of documents in batch, or -1 if it ends inside a document or has a
+// stray closing bracket. The documents are only scanned for where they end,
+// they are parsed once when they are printed.
+int count_documents(padded_string_view batch)
+{
+    json_scanner scanner;
+    string_view rest(batch.data(), batch.size());
+    int count = 0;
+    while (true)
+    {
+        size_t end = scanner.find_value_end(rest);
+        if (end == json_scanner::npos || scanner.stray_bracket)
+        {
+            break;
+        }
+        count++;
+        rest.remove_prefix(end);
+    }
+    if (scanner.finish())
+    {
+        count++;
+    }
+    return scanner.in_value() || scanner.stray_bracket ? -1 : count;
+}
+
+// Prints the documents of a loaded stream like print_documents, on
+// opts.threads threads. The input is cut into batches at newlines. Each
+// worker counts the documents of its batch with a json_scanner, waits until
+// the index of its first one is known from the counts of the batches before
+// it, and prints them. If a batch ends inside a document, as in pretty
+// printed JSON, the worker of that batch prints the rest of the stream.
+// Returns false if the stream is too small to be split.
+bool split_documents(
+    padded_string_view json,
+    const string &root,
+    const options &opts
+)
+{
+    size_t size = json.size();
+    size_t batch_size = split_piece_size(size, opts);
+    // --output-csv infers its columns from the first records
+    if (opts.threads < 2 || csv_output || size <= 2 * batch_size)
+    {
+        return false;
     }
+    vector<size_t> cuts = {0};
+    while (size - cuts.back() > batch_size)
+    {
+        size_t from = cuts.back() + batch_size;
+        auto newline = (const char *)memchr(
+            json.data() + from, '\n', size - from
+        );
+        if (newline == nullptr)
+        {
+            break;
+        }
+        cuts.push_back(newline + 1 - json.data());
+    }
+    if (cuts.back() < size)
+    {
+        cuts.push_back(size);
+    }
+    size_t batches = cuts.size() - 1;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Documents in each batch, -1 if it's not counted yet or -2 if the
+    // batch ends inside a document
+    vector<int> counts(batches, -1);
+    // Index of the first document of the batches up to known
+    vector<int> first(batches);
+    size_t known = 1;
+    // The batch whose worker prints the rest of the stream, if any
+    size_t takeover = batches;
+
+    thread_pool pool(opts.threads);
+    run_ordered(
+        pool, batches,
+        [&](size_t i)
+        {
+            thread_local ondemand::parser parser;
+            padded_string_view batch(
+                json.data() + cuts[i], cuts[i + 1] - cuts[i],
+                json.capacity() - cuts[i]
+            );
+            int count = count_documents(batch);
+            int index;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                counts[i] = count < 0 ? -2 : count;
+                while (known < batches && counts[known - 1] >= 0)
+                {
+                    first[known] = first[known - 1] + counts[known - 1];
+                    known++;
+                }
+                if (counts[known - 1] == -2)
+                {
+                    takeover = known - 1;
+                }
+                cv.notify_all();
+                cv.wait(lock, [&]() { return i < known || i > takeover; });
+                if (i > takeover)
+                {
+                    return;
+                }
+                index = first[i];
+            }
+            if (i == takeover)
+            {
+                batch = padded_string_view(
+                    json.data() + cuts[i], size - cuts[i],
+                    json.capacity() - cuts[i]
+                );
+            }
+            print_documents(parser, batch, index, root, opts);
+        },
+        2 * opts.threads
+    );
+    return true;
+}
+
+// Prints a loaded input under root: as a stream of documents, filtered by a
+// path or as a whole. With split, a large document or stream is printed on
+// opts.threads threads.
+void print_input(
+    ondemand::parser &parser,
+    input_buffer &json,
+    const string &root,
+    const options &opts,
+    bool split = false
+)
+{
+    // Execute as a stream
+    if (opts.stream)
+    {
+        int index = 0;
+        if (!opts.output_ndjson && !csv_output)
+        {
+            print_stream_header(root);
+        }
+        if (!split || !split_documents(json.view(), root, opts))
+        {
+            print_documents(parser, json.view(), index, root, opts);
+        }
+    }
+    // Execute as single document
+    else
+    {
+        ondemand::document doc = parser.iterate(json.view());
+        growing_string path(root);
+        if (opts.output_ndjson)
+        {
+            print_filtered_path_ndjson(ndjson_path, doc);
+        }
+        else if (csv_output)
+        {
+            csv_output->print_document(doc);
+        }
+        else if (opts.output_json && opts.filtered_path.empty())
+        {
+            batched_print(doc.raw_json().value());
+            batched_print("\n");
+        }
+        else if (!opts.filtered_path.empty())
+        {
+            ondemand::value val = doc;
+            path.append(path_expression(opts.filtered_path));
+            int processed = root.size();
+            if (opts.output_json)
+            {
+                print_filtered_path_json(path, processed, val, flags);
+            }
+            else
+            {
+                print_filtered_path(path, processed, val, flags, filters);
+            }
+        }
+        else if (!split || !split_document(doc, json, path, opts))
+        {
+            print_gron_document(doc, path, batched_out, flags, filters);
+        }
+    }
+    if (csv_output)
+    {
+        csv_output->finish();
+    }
+}
+
+// Converts several inputs in parallel, printing their output in argument
+// order. Inputs without their own root are printed as members of the root
+// object, keyed by their name.
+int print_inputs(const options &opts)
+{
+    if (opts.ungron || opts.windowed)
+    {
+        cerr << "--ungron and --windowed work on a single input only\n";
+        return EXIT_FAILURE;
+    }
+    string base_root = opts.pending_root.value_or("json");
+    vector<string> roots;
+    bool has_derived_root = false;
+    for (auto &input : opts.inputs)
+    {
+        if (input.root)
+        {
+            roots.push_back(*input.root);
+            continue;
+        }
+        has_derived_root = true;
+        string key;
+        for (char c : input.name)
+        {
+            if (c == '"' || c == '\\')
+            {
+                key += '\\';
+            }
+            key += c;
+        }
+        growing_string path(base_root);
+        append_object_key(path, key, flags & ~COLOR);
+        roots.emplace_back(path.view());
+    }
+    if (has_derived_root && !opts.output_ndjson)
+    {
+        growing_string path(base_root);
+        print_container_init(path, false, batched_out, flags, filters);
+    }
+    // URLs are downloaded together, the others are loaded by the workers
+    vector<string> urls;
+    vector<size_t> url_index(opts.inputs.size());
+    for (size_t i = 0; i < opts.inputs.size(); i++)
+    {
+        if (is_url(opts.inputs[i].name))
+        {
+            url_index[i] = urls.size();
+            urls.push_back(opts.inputs[i].name);
+        }
+    }
+    thread_pool pool(opts.threads);
+    std::optional<url_fetcher> fetcher;
+    if (!urls.empty())
+    {
+        fetcher.emplace(urls, opts.download, std::max(8u, 2 * opts.threads));
+    }
+    run_ordered(
+        pool, opts.inputs.size(),
+        [&](size_t i)
+        {
+            thread_local ondemand::parser parser;
+            input_buffer json;
+            if (is_url(opts.inputs[i].name))
+            {
+                json = fetcher->take(url_index[i]);
+                decompress_if_needed(json);
+            }
+            else
+            {
+                // Start reading the next file while this one is converted
+                if (i + 1 < opts.inputs.size() &&
+                    !is_url(opts.inputs[i + 1].name) &&
+                    opts.inputs[i + 1].name != "-")
+                {
+                    prefetch_file(opts.inputs[i + 1].name);
+                }
+                json = load_input(opts.inputs[i].name, opts);
+            }
+            print_input(parser, json, roots[i], opts);
+        }
+    );
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char *argv[])
+{
     ondemand::parser parser;
 
     options opts = parse_options(argc, argv);
+    if (opts.color.value_or(
+            opts.output.empty() &&
+            (opts.sink == sink_kind::fd || opts.sink == sink_kind::vmsplice) &&
+            opts.compress == compression::none && isatty(1)
+        ))
+    {
+        flags |= COLOR;
+    }
     if (flags & IGNORE_CASE)
     {
         for (auto &filter : filters)
@@ -441,52 +1038,213 @@ int main(int argc, char *argv[])
         flags |= COLORIZE_MATCHES;
     }
 
-    padded_string json;
-    // Check if filename is provided
-    if (opts.filename.empty() || opts.filename == "-")
+    // Output is written on a separate thread while the next batch is
+    // formatted. Everything queued is written when main returns.
+    std::unique_ptr<output_sink> sink = make_output_sink(opts.sink, opts.output);
+    if (opts.compress != compression::none)
     {
-        // Load string from stdin
-        json = padded_string(readFileIntoString(0));
+        sink = make_compressing_sink(
+            std::move(sink), opts.compress, opts.compress_level, opts.threads,
+            opts.flush_size ? opts.flush_size : 1 << 20
+        );
     }
-    else if (curl_found && opts.filename.compare(0, 7, "http://") == 0 ||
-             opts.filename.compare(0, 8, "https://") == 0)
+    batched_flush_size = opts.flush_size ? opts.flush_size : sink->flush_size();
+    output_writer writer(std::move(sink));
+    active_output_writer = &writer;
+
+    if (opts.output_json &&
+        (opts.stream || opts.ungron || opts.windowed || !filters.empty() ||
+         opts.inputs.size() > 1))
     {
-        json = padded_string(download(opts));
+        cerr << "--output-json works on a single document without --stream, "
+                "--ungron, --windowed or -F\n";
+        return EXIT_FAILURE;
     }
-    else
+
+    if (opts.output_ndjson)
+    {
+        if (opts.output_json || opts.ungron || opts.windowed ||
+            !filters.empty())
+        {
+            cerr << "--output-ndjson can't be combined with --output-json, "
+                    "--ungron, --windowed or -F\n";
+            return EXIT_FAILURE;
+        }
+        ndjson_path = parse_path(path_expression(opts.filtered_path));
+    }
+
+    if (opts.output_csv)
+    {
+        if (opts.output_json || opts.output_ndjson || opts.ungron ||
+            opts.windowed || !filters.empty() || opts.inputs.size() > 1)
+        {
+            cerr << "--output-csv and --output-tsv work on a single input "
+                    "without --output-json, --output-ndjson, --ungron, "
+                    "--windowed or -F\n";
+            return EXIT_FAILURE;
+        }
+        csv_output = std::make_unique<csv_writer>(
+            parse_path(path_expression(opts.filtered_path)), opts.output_csv,
+            opts.infer_columns
+        );
+    }
+
+    if ((flags & VALUES_ONLY) && (flags & (PATHS_ONLY | PREFIX_DELTA)))
+    {
+        cerr << "--values can't be combined with --paths or --prefix-delta\n";
+        return EXIT_FAILURE;
+    }
+
+    if (flags & PREFIX_DELTA)
+    {
+        // Lines have to be printed in output order from the same path
+        if (opts.stream || opts.windowed || opts.output_json ||
+            opts.output_ndjson || (flags & SORT_OUTPUT))
+        {
+            cerr << "--prefix-delta can't be combined with --stream, "
+                    "--windowed, --output-json, --output-ndjson or --sort\n";
+            return EXIT_FAILURE;
+        }
+        flags &= ~(COLOR | COLORIZE_MATCHES);
+    }
+
+    if (opts.inputs.size() > 1)
+    {
+        return print_inputs(opts);
+    }
+
+    if (opts.windowed)
     {
-        json = padded_string::load(opts.filename);
+        if (opts.stream || opts.ungron || !opts.filtered_path.empty() ||
+            (flags & SORT_OUTPUT) || is_url(opts.filename))
+        {
+            cerr << "--windowed can't be combined with --stream, --ungron, "
+                    "--sort, a path or a URL\n";
+            return EXIT_FAILURE;
+        }
+        growing_string path(root);
+        print_gron_windowed(open_input(opts.filename), path, flags, filters);
+        batched_print_flush();
+        return EXIT_SUCCESS;
     }
 
+    // Documents that are piped in or downloaded are printed as soon as they
+    // arrive, and compressed documents are printed while they are being
+    // decompressed
+    if (opts.stream && !opts.ungron)
+    {
+        std::unique_ptr<input_source> source;
+        if (is_url(opts.filename))
+        {
+            source = open_input_source(
+                open_url_source(opts.filename, opts.download), true
+            );
+        }
+        else
+        {
+            int fd = open_input(opts.filename);
+            if (!is_uncompressed_regular_file(fd))
+            {
+                source = open_input_source(fd, true);
+            }
+            else if (fd != 0)
+            {
+                close(fd);
+            }
+        }
+        if (source)
+        {
+            int index = 0;
+            if (!opts.output_ndjson && !csv_output)
+            {
+                print_stream_header(root);
+            }
+            batched_print_flush();
+            read_document_batches(
+                std::move(source),
+                [&](padded_string_view batch)
+                {
+                    print_documents(parser, batch, index, root, opts);
+                    batched_print_flush();
+                }
+            );
+            if (csv_output)
+            {
+                csv_output->finish();
+            }
+            return EXIT_SUCCESS;
+        }
+    }
+
+    input_buffer json = load_input(opts.filename, opts);
+
     if (opts.ungron)
     {
         Builder builder;
-        char *data = json.data();
+        const char *data = json.data;
         string_view last_line = "";
-        while (data < json.data() + json.size())
+        // Last line of --prefix-delta output, and the number of bytes shared
+        // by the lines read since the last parsed one
+        growing_string delta_line;
+        size_t delta_shared = 0;
+        while (data < json.data + json.len)
         {
-            char *end = data;
-            while (end < json.data() + json.size() && *end != '\n')
+            const char *end = data;
+            while (end < json.data + json.len && *end != '\n')
             {
                 end++;
             }
             string_view line_orig = string_view(data, end - data);
+            // --prefix-delta line: the number of bytes shared with the
+            // previous line, a space and the rest of the line
+            bool is_delta = !line_orig.empty() && isdigit(line_orig[0]);
+            const char *suffix = nullptr;
+            size_t shared = 0;
+            if (is_delta)
+            {
+                const char *p = data;
+                while (p < end && isdigit(*p))
+                {
+                    shared = shared * 10 + (*p++ - '0');
+                }
+                if (p == end || *p != ' ' || shared > delta_line.size())
+                {
+                    cerr << "Invalid --prefix-delta line: " << line_orig
+                         << "\n";
+                    return EXIT_FAILURE;
+                }
+                suffix = p + 1;
+                delta_line.erase(shared);
+                delta_line.append(string_view(suffix, end - suffix));
+                delta_shared = std::min(delta_shared, shared);
+                line_orig = delta_line.view();
+            }
             if (!can_show(line_orig, flags, filters))
             {
                 data = end + 1;
                 continue;
             }
-            if (line_orig.starts_with(root))
+            string_view line = line_orig;
+            if (line.starts_with(root))
             {
-                data = data + root.size();
+                line.remove_prefix(root.size());
             }
-            string_view line = string_view(data, end - data);
             // find commonality with last line
             int common = 0;
-            while (common < line.size() && common < last_line.size() &&
-                   line[common] == last_line[common])
+            if (is_delta)
             {
-                common++;
+                common = std::max(
+                    (int)delta_shared - (int)(line_orig.size() - line.size()),
+                    0
+                );
+            }
+            else
+            {
+                while (common < line.size() && common < last_line.size() &&
+                       line[common] == last_line[common])
+                {
+                    common++;
+                }
             }
             // if it's not a token ending, make sure we don't use the last token
             if (common < line.size() && line[common] != ' ' &&
@@ -519,8 +1277,34 @@ int main(int argc, char *argv[])
                 parse_gron_builders, parse_gron_builder_offsets
             );
 
-            // parse_gron(line, builder, 0);
-            last_line = line;
+            if (is_delta)
+            {
+                // The value points into delta_line, which is overwritten by
+                // the next line; point it to the same bytes of the input.
+                Builder &assigned = parse_gron_builders.empty()
+                                        ? builder
+                                        : *parse_gron_builders.back();
+                string_view value;
+                if (std::holds_alternative<string_variant>(assigned) &&
+                    !(value = std::get<string_variant>(assigned)).empty())
+                {
+                    size_t pos = value.data() - delta_line.data;
+                    if (pos < shared)
+                    {
+                        cerr << "Invalid --prefix-delta line: " << line_orig
+                             << "\n";
+                        return EXIT_FAILURE;
+                    }
+                    assigned = string_view(suffix + pos - shared, value.size());
+                }
+                delta_shared = delta_line.size();
+                last_line = "";
+            }
+            else
+            {
+                // parse_gron(line, builder, 0);
+                last_line = line;
+            }
             data = end + 1;
         }
         if (std::holds_alternative<string_variant>(builder) &&
@@ -555,49 +1339,7 @@ int main(int argc, char *argv[])
         return EXIT_SUCCESS;
     }
 
-    // Execute as a stream
-    if (opts.stream)
-    {
-        ondemand::document_stream docs = parser.iterate_many(json);
-        int index = 0;
-        gprint(root + " = [];\n", batched_out, flags, filters);
-        for (auto doc : docs)
-        {
-            growing_string path = growing_string(root);
-            path.append("[").append(to_string(index++)).append("]");
-            recursive_print_gron(doc, path, batched_out, flags, filters);
-        }
-    }
-    // Execute as single document
-    else
-    {
-        ondemand::document doc = parser.iterate(json);
-        ondemand::value val = doc;
-        growing_string path(root);
-        if (!opts.filtered_path.empty())
-        {
-            if (opts.filtered_path.starts_with(root))
-            {
-                path.erase(0);
-            }
-            else if (!(opts.filtered_path[0] == '.' ||
-                       opts.filtered_path[0] == '['))
-            {
-                path.append(".");
-            }
-            path.append(opts.filtered_path);
-            int processed = 0;
-            if (processed == 0 && path.starts_with(root))
-            {
-                processed = root.size();
-            }
-            print_filtered_path(path, processed, val, flags, filters);
-        }
-        else
-        {
-            recursive_print_gron(val, path, batched_out, flags, filters);
-        }
-    }
+    print_input(parser, json, root, opts, true);
     batched_print_flush();
 
     return EXIT_SUCCESS;
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cstring>
 #include <string_view>
+#include <utility>
 using std::max;
 using std::string_view;
 
@@ -14,6 +15,9 @@ struct growing_string
     char *data;
     size_t len = 0;
     size_t capacity;
+    // Length of the prefix that wasn't erased since it was last set. Lines
+    // printed from a path share this many bytes with the previous one.
+    size_t unchanged_len = 0;
 
     growing_string() : capacity(1000) { data = new char[capacity]; }
 
@@ -75,13 +79,30 @@ struct growing_string
         {
             len = newlen;
         }
+        unchanged_len = std::min(unchanged_len, newlen);
         return *this;
     }
 
     inline size_t size() const { return len; }
 
+    // Returns the bytes from pos to be changed in place.
+    char *modify(size_t pos)
+    {
+        unchanged_len = std::min(unchanged_len, pos);
+        return data + pos;
+    }
+
     operator string_view() const { return {data, len}; }
 
+    // Exchanges the content and storage of two strings without copying.
+    void swap(growing_string &other)
+    {
+        std::swap(data, other.data);
+        std::swap(len, other.len);
+        std::swap(capacity, other.capacity);
+        std::swap(unchanged_len, other.unchanged_len);
+    }
+
     void clear_mem()
     {
         len = 0;
@@ -0,0 +1,259 @@
+#include "input_buffer.hpp"
+#include "uring_reader.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sys/stat.h>
+
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using std::cerr;
+
+input_buffer::input_buffer(input_buffer &&other) noexcept
+    : data(other.data), len(other.len), capacity(other.capacity),
+      mapped_len(other.mapped_len)
+{
+    other.data = nullptr;
+    other.len = other.capacity = other.mapped_len = 0;
+}
+
+input_buffer &input_buffer::operator=(input_buffer &&other) noexcept
+{
+    if (this != &other)
+    {
+        release();
+        data = other.data;
+        len = other.len;
+        capacity = other.capacity;
+        mapped_len = other.mapped_len;
+        other.data = nullptr;
+        other.len = other.capacity = other.mapped_len = 0;
+    }
+    return *this;
+}
+
+input_buffer::~input_buffer() { release(); }
+
+void input_buffer::release()
+{
+#ifndef _MSC_VER
+    if (mapped_len)
+    {
+        munmap(data, mapped_len);
+    }
+    else
+#endif
+    {
+        free(data);
+    }
+    data = nullptr;
+    len = capacity = mapped_len = 0;
+}
+
+void input_buffer::allocate(size_t size)
+{
+    release();
+    data = (char *)malloc(size + simdjson::SIMDJSON_PADDING);
+    if (data == nullptr)
+    {
+        cerr << "malloc() failed\n";
+        exit(EXIT_FAILURE);
+    }
+    capacity = size + simdjson::SIMDJSON_PADDING;
+}
+
+void input_buffer::reserve_extra(size_t extra)
+{
+    if (len + extra + simdjson::SIMDJSON_PADDING <= capacity)
+    {
+        return;
+    }
+    if (mapped_len)
+    {
+        cerr << "Can't grow a memory mapped buffer\n";
+        exit(EXIT_FAILURE);
+    }
+    size_t new_capacity =
+        std::max(capacity * 2, len + extra + simdjson::SIMDJSON_PADDING);
+    char *new_data = (char *)realloc(data, new_capacity);
+    if (new_data == nullptr)
+    {
+        cerr << "realloc() failed\n";
+        exit(EXIT_FAILURE);
+    }
+    data = new_data;
+    capacity = new_capacity;
+}
+
+static input_buffer read_whole_file(const string &filename)
+{
+    input_buffer buffer;
+    FILE *fp = std::fopen(filename.c_str(), "rb");
+    if (fp == nullptr)
+    {
+        cerr << "Failed to open file: " << filename << "\n";
+        exit(EXIT_FAILURE);
+    }
+    if (std::fseek(fp, 0, SEEK_END) < 0)
+    {
+        cerr << "Failed to read file: " << filename << "\n";
+        exit(EXIT_FAILURE);
+    }
+    long size = std::ftell(fp);
+    std::rewind(fp);
+    buffer.allocate(size);
+    buffer.len = std::fread(buffer.data, 1, size, fp);
+    std::fclose(fp);
+    if (buffer.len != (size_t)size)
+    {
+        cerr << "Failed to read file: " << filename << "\n";
+        exit(EXIT_FAILURE);
+    }
+    memset(buffer.data + buffer.len, 0, simdjson::SIMDJSON_PADDING);
+    return buffer;
+}
+
+input_buffer load_file(const string &filename, load_method method)
+{
+#ifndef _MSC_VER
+    if (method == load_method::io_uring)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd != -1 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+            st.st_size > 0)
+        {
+            input_buffer buffer;
+            buffer.allocate(st.st_size);
+            if (uring_read_file(fd, buffer.data, st.st_size))
+            {
+                close(fd);
+                buffer.len = st.st_size;
+                buffer.pad();
+                return buffer;
+            }
+        }
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+    if (method == load_method::mmap)
+    {
+        int fd = open(filename.c_str(), O_RDONLY);
+        struct stat st;
+        if (fd != -1 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode) &&
+            st.st_size > 0)
+        {
+            size_t page_size = sysconf(_SC_PAGESIZE);
+            size_t size = st.st_size;
+            size_t mapped_len = (size + page_size - 1) / page_size * page_size;
+            // The bytes between the end of the file and the end of its last
+            // page read as zeros, so they can serve as the padding.
+            if (mapped_len - size >= simdjson::SIMDJSON_PADDING)
+            {
+                void *p = mmap(nullptr, mapped_len, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (p != MAP_FAILED)
+                {
+                    close(fd);
+                    madvise(p, mapped_len, MADV_SEQUENTIAL);
+                    input_buffer buffer;
+                    buffer.data = (char *)p;
+                    buffer.len = size;
+                    buffer.capacity = mapped_len;
+                    buffer.mapped_len = mapped_len;
+                    return buffer;
+                }
+            }
+        }
+        if (fd != -1)
+        {
+            close(fd);
+        }
+    }
+#endif
+    return read_whole_file(filename);
+}
+
+void prefetch_file(const string &filename)
+{
+#if defined(POSIX_FADV_WILLNEED)
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd != -1)
+    {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        close(fd);
+    }
+#endif
+}
+
+input_buffer read_fd(int fd)
+{
+    input_buffer buffer;
+    size_t chunk = 1 << 16;
+    const size_t max_chunk = 1 << 24;
+    struct stat st;
+    if (fstat(fd, &st) == 0)
+    {
+        if (S_ISREG(st.st_mode))
+        {
+#ifdef _MSC_VER
+            off_t offset = 0;
+#else
+            off_t offset = lseek(fd, 0, SEEK_CUR);
+#endif
+            if (offset >= 0 && st.st_size > offset)
+            {
+                // Leave room for one more byte so that the final read
+                // returning 0 doesn't force a reallocation.
+                chunk = st.st_size - offset + 1;
+            }
+        }
+#if defined(F_SETPIPE_SZ)
+        else if (S_ISFIFO(st.st_mode))
+        {
+            // A bigger pipe lets the writer run further ahead of us and
+            // makes each read return more data.
+            fcntl(fd, F_SETPIPE_SZ, 1 << 20);
+        }
+#endif
+    }
+    buffer.allocate(chunk);
+
+    while (true)
+    {
+        size_t room = buffer.capacity - simdjson::SIMDJSON_PADDING - buffer.len;
+        if (room == 0)
+        {
+            // Grow geometrically so that fast producers are read with fewer,
+            // bigger reads.
+            buffer.reserve_extra(chunk);
+            chunk = std::min(chunk * 2, max_chunk);
+            room = buffer.capacity - simdjson::SIMDJSON_PADDING - buffer.len;
+        }
+        ssize_t bytes_read = read(fd, buffer.data + buffer.len, room);
+        if (bytes_read == 0)
+        {
+            break;
+        }
+        if (bytes_read == -1)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            cerr << "Failed to read file\n";
+            exit(EXIT_FAILURE);
+        }
+        buffer.len += bytes_read;
+    }
+    buffer.pad();
+    return buffer;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "simdjson.h"
+#include <cstring>
+#include <string>
+#include <string_view>
+using std::string;
+using std::string_view;
+
+// Holds the input document followed by at least SIMDJSON_PADDING readable
+// bytes, which is what simdjson needs to parse it in place.
+// The bytes are either owned heap memory or a read-only mapping of the input
+// file, in which case the padding is the zero filled tail of the last page.
+struct input_buffer
+{
+    char *data = nullptr;
+    size_t len = 0;
+    // Number of readable bytes at data, including the padding
+    size_t capacity = 0;
+    // Non-zero if data points to a memory mapping of this size
+    size_t mapped_len = 0;
+
+    input_buffer() = default;
+    input_buffer(const input_buffer &) = delete;
+    input_buffer &operator=(const input_buffer &) = delete;
+    input_buffer(input_buffer &&other) noexcept;
+    input_buffer &operator=(input_buffer &&other) noexcept;
+    ~input_buffer();
+
+    // Allocates an owned buffer that can hold size bytes and the padding.
+    void allocate(size_t size);
+
+    // Makes room for extra more bytes after len (plus the padding), keeping
+    // the existing content.
+    void reserve_extra(size_t extra);
+
+    // Zeroes the padding after the content.
+    void pad() { memset(data + len, 0, simdjson::SIMDJSON_PADDING); }
+
+    bool is_mapped() const { return mapped_len != 0; }
+
+    simdjson::padded_string_view view() const
+    {
+        return simdjson::padded_string_view(data, len, capacity);
+    }
+
+    string_view str() const { return string_view(data, len); }
+
+  private:
+    // Frees or unmaps data and leaves the buffer empty.
+    void release();
+};
+
+// How load_file gets the content of regular files
+enum class load_method
+{
+    // Memory mapped without copying unless the file ends too close to a page
+    // boundary to leave room for the padding
+    mmap,
+    read,
+    // Read with several reads in flight, falling back to read() if io_uring
+    // isn't available
+    io_uring
+};
+
+// Loads a file into a padded buffer.
+input_buffer load_file(const string &filename, load_method method);
+
+// Asks the kernel to start reading filename into the page cache, so that it's
+// there by the time it's loaded.
+void prefetch_file(const string &filename);
+
+// Reads everything from fd directly into a padded buffer. If fd is a regular
+// file the buffer is sized up front, otherwise reads grow with the input.
+input_buffer read_fd(int fd);
@@ -0,0 +1,53 @@
+#include "input_source.hpp"
+#include <algorithm>
+#include <cstring>
+
+bool queued_source::push(std::vector<char> block)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return queued_bytes < max_bytes || stopped; });
+    if (stopped)
+    {
+        return false;
+    }
+    queued_bytes += block.size();
+    blocks.push_back(std::move(block));
+    cv.notify_all();
+    return true;
+}
+
+void queued_source::close()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    done = true;
+    cv.notify_all();
+}
+
+void queued_source::stop()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    stopped = true;
+    cv.notify_all();
+}
+
+size_t queued_source::read(char *buf, size_t n)
+{
+    while (current_pos == current.size())
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        cv.wait(lock, [&]() { return !blocks.empty() || done; });
+        if (blocks.empty())
+        {
+            return 0;
+        }
+        current = std::move(blocks.front());
+        blocks.pop_front();
+        queued_bytes -= current.size();
+        current_pos = 0;
+        cv.notify_all();
+    }
+    size_t len = std::min(n, current.size() - current_pos);
+    memcpy(buf, current.data() + current_pos, len);
+    current_pos += len;
+    return len;
+}
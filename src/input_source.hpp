@@ -0,0 +1,42 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+// Sequential reader of input bytes
+struct input_source
+{
+    virtual ~input_source() = default;
+    // Reads at most n bytes into buf, returns 0 at the end of the input.
+    virtual size_t read(char *buf, size_t n) = 0;
+};
+
+// Input produced by another thread. The producer waits while max_bytes are
+// queued, so it can only run a bounded distance ahead of the reader.
+class queued_source : public input_source
+{
+  public:
+    static const size_t max_bytes = 4 << 20;
+
+    // Queues a block for reading. Returns false if the reader stopped, in
+    // which case the producer should give up.
+    bool push(std::vector<char> block);
+    // Marks the end of the input.
+    void close();
+    // Called by the reader when it doesn't need more input.
+    void stop();
+
+    size_t read(char *buf, size_t n) override;
+
+  private:
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::vector<char>> blocks;
+    size_t queued_bytes = 0;
+    bool done = false;
+    bool stopped = false;
+    std::vector<char> current;
+    size_t current_pos = 0;
+};
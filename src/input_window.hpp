@@ -0,0 +1,137 @@
+#pragma once
+#include "decompress.hpp"
+#include "input_buffer.hpp"
+#include "json_scanner.hpp"
+#include <iostream>
+#include <memory>
+#include <string>
+using std::cerr;
+using std::string;
+
+// Input is read in pieces of this size. The window only grows if a single
+// value doesn't fit in it.
+inline const size_t window_size = 1 << 22;
+
+// A sliding window over the input read from a source. Consumed bytes are
+// dropped from the front when more input is read, so memory use depends only
+// on how much of the input is needed at once.
+struct input_window
+{
+    std::unique_ptr<input_source> source;
+    input_buffer buffer;
+    // First byte that wasn't consumed yet
+    size_t pos = 0;
+    // Number of bytes dropped from the front of the buffer, for error messages
+    size_t dropped = 0;
+    bool eof = false;
+
+    input_window(std::unique_ptr<input_source> source)
+        : source(std::move(source))
+    {
+        buffer.allocate(window_size);
+    }
+
+    // Compressed input is decompressed on a separate thread.
+    input_window(int fd) : input_window(open_input_source(fd, true)) {}
+
+    [[noreturn]] void error(const char *message)
+    {
+        cerr << message << " at byte " << dropped + pos << "\n";
+        exit(EXIT_FAILURE);
+    }
+
+    // Reads more input after the unconsumed bytes, which are moved to the
+    // start of the buffer. Returns false at the end of the input.
+    bool read_more()
+    {
+        if (eof)
+        {
+            return false;
+        }
+        memmove(buffer.data, buffer.data + pos, buffer.len - pos);
+        buffer.len -= pos;
+        dropped += pos;
+        pos = 0;
+        if (buffer.capacity - simdjson::SIMDJSON_PADDING - buffer.len <
+            window_size / 2)
+        {
+            buffer.reserve_extra(window_size);
+        }
+        size_t bytes_read = source->read(
+            buffer.data + buffer.len,
+            buffer.capacity - simdjson::SIMDJSON_PADDING - buffer.len
+        );
+        if (bytes_read == 0)
+        {
+            eof = true;
+            return false;
+        }
+        buffer.len += bytes_read;
+        return true;
+    }
+
+    // Skips whitespace and returns the next byte without consuming it, or -1
+    // at the end of the input.
+    int peek()
+    {
+        while (true)
+        {
+            while (pos < buffer.len)
+            {
+                char c = buffer.data[pos];
+                if (c != ' ' && c != '\n' && c != '\r' && c != '\t')
+                {
+                    return (unsigned char)c;
+                }
+                pos++;
+            }
+            if (!read_more())
+            {
+                return -1;
+            }
+        }
+    }
+
+    void expect(char c)
+    {
+        if (peek() != c)
+        {
+            error((string("Expected ") + c).c_str());
+        }
+        pos++;
+    }
+
+    // Makes sure that the whole value starting at pos is in the buffer and
+    // returns its length.
+    size_t scan_value()
+    {
+        json_scanner scanner;
+        size_t scanned = 0;
+        while (true)
+        {
+            size_t end = scanner.find_value_end(
+                string_view(buffer.data + pos + scanned, buffer.len - pos - scanned)
+            );
+            if (end != json_scanner::npos)
+            {
+                return scanned + end;
+            }
+            scanned = buffer.len - pos;
+            if (!read_more())
+            {
+                if (scanner.finish())
+                {
+                    return scanned;
+                }
+                error("Unexpected end of input");
+            }
+        }
+    }
+
+    simdjson::padded_string_view view(size_t len) const
+    {
+        return simdjson::padded_string_view(
+            buffer.data + pos, len, buffer.capacity - pos
+        );
+    }
+};
@@ -0,0 +1,126 @@
+#pragma once
+#include "key_scan.hpp"
+#include <cstddef>
+#include <string_view>
+using std::string_view;
+
+// Finds where JSON values end in a byte stream without parsing them, so that
+// the input can be cut into pieces that simdjson can parse separately.
+// The scanner keeps its state between calls, so a value can be fed in as many
+// pieces as it arrives in.
+struct json_scanner
+{
+    static constexpr size_t npos = string_view::npos;
+
+    int depth = 0;
+    bool in_string = false;
+    bool in_escape = false;
+    bool in_scalar = false;
+    // Set when a closing bracket was found outside of any value
+    bool stray_bracket = false;
+
+    bool in_value() const { return depth > 0 || in_string || in_scalar; }
+
+    void reset()
+    {
+        depth = 0, in_string = in_escape = in_scalar = stray_bracket = false;
+    }
+
+    // Scans s, which continues the bytes fed so far. Returns the offset one
+    // past the end of the first top level value that completes in s, or npos
+    // if more input is needed. Whitespace before the value is skipped. A number
+    // or literal ends at the first byte after it, so at the end of the input
+    // call finish() to find out whether one was still open. A closing bracket
+    // outside of any value sets stray_bracket and returns its offset, since
+    // the input is invalid from there on.
+    size_t find_value_end(string_view s)
+    {
+        for (size_t i = 0; i < s.size(); i++)
+        {
+            if (depth > 0)
+            {
+                // Inside an array or object only strings and brackets matter
+                size_t end = active_key_scanner->nested_end(
+                    s.substr(i), depth, in_string, in_escape
+                );
+                return depth == 0 ? i + end : npos;
+            }
+            // The rest is at the top level
+            char c = s[i];
+            if (in_string)
+            {
+                // Skip the common part of strings quickly
+                while (!in_escape && c != '"' && c != '\\' && ++i < s.size())
+                {
+                    c = s[i];
+                }
+                if (i == s.size())
+                {
+                    break;
+                }
+                if (in_escape)
+                {
+                    in_escape = false;
+                }
+                else if (c == '\\')
+                {
+                    in_escape = true;
+                }
+                else if (c == '"')
+                {
+                    in_string = false;
+                    return i + 1;
+                }
+                continue;
+            }
+            if (in_scalar)
+            {
+                if (is_scalar_char(c))
+                {
+                    continue;
+                }
+                in_scalar = false;
+                return i;
+            }
+            switch (c)
+            {
+            case '"':
+                in_string = true;
+                break;
+            case '[':
+            case '{':
+                depth++;
+                break;
+            case ']':
+            case '}':
+                stray_bracket = true;
+                return i;
+            case ' ':
+            case '\t':
+            case '\n':
+            case '\r':
+            case ',':
+            case ':':
+                break;
+            default:
+                in_scalar = true;
+            }
+        }
+        return npos;
+    }
+
+    // Returns true if a number or literal was open at the end of the input,
+    // which the end of the input completes.
+    bool finish()
+    {
+        bool open = in_scalar;
+        in_scalar = false;
+        return open;
+    }
+
+    static bool is_scalar_char(char c)
+    {
+        return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+               (c >= 'A' && c <= 'Z') || c == '-' || c == '+' || c == '.';
+    }
+};
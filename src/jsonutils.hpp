@@ -19,6 +19,10 @@ const unsigned IGNORE_CASE = 32;
 const unsigned SORT_OUTPUT = 64;
 const unsigned INDENT = 128;
 const unsigned NEWLINE = 256;
+const unsigned PREFIX_DELTA = 512;
+const unsigned SKIP_INITIALIZERS = 1024;
+const unsigned VALUES_ONLY = 2048;
+const unsigned PATHS_ONLY = 4096;
 
 inline bool is_js_identifier(string_view s)
 {
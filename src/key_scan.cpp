@@ -0,0 +1,213 @@
+#include "key_scan.hpp"
+#include "jsonutils.hpp"
+#include "key_scan_kernels.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define KEY_SCAN_SSE2
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KEY_SCAN_NEON
+#endif
+
+static raw_key scalar_scan_padded_key(const char *s)
+{
+    int length = raw_json_string_length(s);
+    return {
+        length, length != -1 && is_js_identifier(string_view(s, length))};
+}
+
+static int scalar_string_length(string_view s)
+{
+    return raw_json_string_length(s);
+}
+
+static bool scalar_is_identifier(string_view s) { return is_js_identifier(s); }
+
+static size_t scalar_nested_end(
+    string_view s, int &depth, bool &in_string, bool &in_escape
+)
+{
+    return nested_end_from(
+        s, 0, in_escape ? 0 : SIZE_MAX, depth, in_string, in_escape
+    );
+}
+
+static const key_scanner scalar_key_scanner = {
+    "scalar", scalar_scan_padded_key, scalar_string_length,
+    scalar_is_identifier, scalar_nested_end};
+
+#ifdef KEY_SCAN_SSE2
+// SSE2 is part of x86-64, so it needs no check
+struct sse2
+{
+    static constexpr const char *name = "sse2";
+    static constexpr size_t size = 16;
+    static constexpr int bits = 1;
+
+    static __m128i load(const char *p)
+    {
+        return _mm_loadu_si128((const __m128i *)p);
+    }
+
+    static __m128i eq(__m128i v, char c)
+    {
+        return _mm_cmpeq_epi8(v, _mm_set1_epi8(c));
+    }
+
+    static uint64_t special_mask(__m128i v)
+    {
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(eq(v, '"'), eq(v, '\\')),
+            _mm_or_si128(_mm_or_si128(eq(v, '\n'), eq(v, '\r')), eq(v, 0))
+        );
+        return (uint32_t)_mm_movemask_epi8(m);
+    }
+
+    // Signed compares, so bytes from 0x80 are never in a range
+    static __m128i in_range(__m128i v, char low, char high)
+    {
+        return _mm_and_si128(
+            _mm_cmpgt_epi8(v, _mm_set1_epi8(low - 1)),
+            _mm_cmplt_epi8(v, _mm_set1_epi8(high + 1))
+        );
+    }
+
+    static uint64_t non_identifier_mask(__m128i v)
+    {
+        // Setting 0x20 turns upper case letters into lower case ones
+        __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        __m128i m = _mm_or_si128(
+            _mm_or_si128(in_range(lower, 'a', 'z'), in_range(v, '0', '9')),
+            eq(v, '_')
+        );
+        return (uint32_t)_mm_movemask_epi8(m) ^ 0xffff;
+    }
+
+    static uint64_t eq_mask(__m128i v, char c)
+    {
+        return (uint32_t)_mm_movemask_epi8(eq(v, c));
+    }
+
+    static uint64_t bracket_mask(__m128i v)
+    {
+        // Setting 0x20 turns [ and ] into { and }
+        __m128i brace = _mm_or_si128(v, _mm_set1_epi8(0x20));
+        return (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(eq(brace, '{'), eq(brace, '}'))
+        );
+    }
+};
+
+static const key_scanner sse2_key_scanner = make_key_scanner<sse2>();
+#endif
+
+#ifdef KEY_SCAN_AVX2
+// Defined in key_scan_avx2.cpp, which is compiled with AVX2 enabled
+extern const key_scanner avx2_key_scanner;
+#endif
+
+#ifdef KEY_SCAN_NEON
+struct neon
+{
+    static constexpr const char *name = "neon";
+    static constexpr size_t size = 16;
+    // NEON has no movemask, the narrowing shift leaves 4 bits per byte
+    static constexpr int bits = 4;
+
+    static uint8x16_t load(const char *p) { return vld1q_u8((const uint8_t *)p); }
+
+    static uint8x16_t eq(uint8x16_t v, char c)
+    {
+        return vceqq_u8(v, vdupq_n_u8(c));
+    }
+
+    static uint64_t to_mask(uint8x16_t m)
+    {
+        return vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0
+        );
+    }
+
+    static uint64_t special_mask(uint8x16_t v)
+    {
+        return to_mask(vorrq_u8(
+            vorrq_u8(eq(v, '"'), eq(v, '\\')),
+            vorrq_u8(vorrq_u8(eq(v, '\n'), eq(v, '\r')), eq(v, 0))
+        ));
+    }
+
+    static uint8x16_t in_range(uint8x16_t v, char low, char high)
+    {
+        return vcleq_u8(vsubq_u8(v, vdupq_n_u8(low)), vdupq_n_u8(high - low));
+    }
+
+    static uint64_t non_identifier_mask(uint8x16_t v)
+    {
+        // Setting 0x20 turns upper case letters into lower case ones
+        uint8x16_t lower = vorrq_u8(v, vdupq_n_u8(0x20));
+        return ~to_mask(vorrq_u8(
+            vorrq_u8(in_range(lower, 'a', 'z'), in_range(v, '0', '9')),
+            eq(v, '_')
+        ));
+    }
+
+    static uint64_t eq_mask(uint8x16_t v, char c) { return to_mask(eq(v, c)); }
+
+    static uint64_t bracket_mask(uint8x16_t v)
+    {
+        // Setting 0x20 turns [ and ] into { and }
+        uint8x16_t brace = vorrq_u8(v, vdupq_n_u8(0x20));
+        return to_mask(vorrq_u8(eq(brace, '{'), eq(brace, '}')));
+    }
+};
+
+static const key_scanner neon_key_scanner = make_key_scanner<neon>();
+#endif
+
+const std::vector<const key_scanner *> &supported_key_scanners()
+{
+    static const std::vector<const key_scanner *> scanners = []()
+    {
+        std::vector<const key_scanner *> scanners = {&scalar_key_scanner};
+#ifdef KEY_SCAN_SSE2
+        scanners.push_back(&sse2_key_scanner);
+#ifdef KEY_SCAN_AVX2
+        if (__builtin_cpu_supports("avx2"))
+        {
+            scanners.push_back(&avx2_key_scanner);
+        }
+#endif
+#endif
+#ifdef KEY_SCAN_NEON
+        scanners.push_back(&neon_key_scanner);
+#endif
+        return scanners;
+    }();
+    return scanners;
+}
+
+static const key_scanner *choose_key_scanner()
+{
+    auto &scanners = supported_key_scanners();
+    const char *forced = getenv("FASTGRON_FORCE_KEY_SCANNER");
+    if (forced == nullptr)
+    {
+        return scanners.back();
+    }
+    for (auto scanner : scanners)
+    {
+        if (strcmp(scanner->name, forced) == 0)
+        {
+            return scanner;
+        }
+    }
+    std::cerr << "Key scanner " << forced << " isn't supported on this CPU\n";
+    exit(EXIT_FAILURE);
+}
+
+const key_scanner *active_key_scanner = choose_key_scanner();
@@ -0,0 +1,41 @@
+#pragma once
+#include <string_view>
+#include <vector>
+using std::string_view;
+
+// Length of a raw JSON string up to its closing quote, and whether the
+// string is a JavaScript identifier that can be printed as .key
+struct raw_key
+{
+    // -1 if a newline or the end is reached before the closing quote
+    int length;
+    bool identifier;
+};
+
+// Vectorized versions of raw_json_string_length and is_js_identifier from
+// jsonutils.hpp, which they have to agree with, and of the scan json_scanner
+// does inside arrays and objects. Like simdjson's implementations, the
+// fastest one the CPU supports is picked at startup, unless
+// FASTGRON_FORCE_KEY_SCANNER names another one.
+struct key_scanner
+{
+    const char *name;
+    // s has to be followed by SIMDJSON_PADDING readable bytes after the
+    // closing quote, as in a document parsed by simdjson.
+    raw_key (*scan_padded_key)(const char *s);
+    int (*string_length)(string_view s);
+    bool (*is_identifier)(string_view s);
+    // Scans s inside an array or object that is depth levels deep, skipping
+    // strings. Returns the offset one past the bracket that closes it, or
+    // s.size() if it doesn't close in s. depth, in_string and in_escape (the
+    // byte after a backslash in a string is next) carry over to the next
+    // call.
+    size_t (*nested_end)(
+        string_view s, int &depth, bool &in_string, bool &in_escape
+    );
+};
+
+extern const key_scanner *active_key_scanner;
+
+// The scanners this CPU supports, the scalar one first
+const std::vector<const key_scanner *> &supported_key_scanners();
@@ -0,0 +1,70 @@
+// Compiled with AVX2 enabled, and only used if the CPU supports it
+#include "key_scan_kernels.hpp"
+#include <immintrin.h>
+
+namespace
+{
+
+struct avx2
+{
+    static constexpr const char *name = "avx2";
+    static constexpr size_t size = 32;
+    static constexpr int bits = 1;
+
+    static __m256i load(const char *p)
+    {
+        return _mm256_loadu_si256((const __m256i *)p);
+    }
+
+    static __m256i eq(__m256i v, char c)
+    {
+        return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(c));
+    }
+
+    static uint64_t special_mask(__m256i v)
+    {
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(eq(v, '"'), eq(v, '\\')),
+            _mm256_or_si256(_mm256_or_si256(eq(v, '\n'), eq(v, '\r')), eq(v, 0))
+        );
+        return (uint32_t)_mm256_movemask_epi8(m);
+    }
+
+    // Signed compares, so bytes from 0x80 are never in a range
+    static __m256i in_range(__m256i v, char low, char high)
+    {
+        return _mm256_and_si256(
+            _mm256_cmpgt_epi8(v, _mm256_set1_epi8(low - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(high + 1), v)
+        );
+    }
+
+    static uint64_t non_identifier_mask(__m256i v)
+    {
+        // Setting 0x20 turns upper case letters into lower case ones
+        __m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        __m256i m = _mm256_or_si256(
+            _mm256_or_si256(in_range(lower, 'a', 'z'), in_range(v, '0', '9')),
+            eq(v, '_')
+        );
+        return (uint32_t)_mm256_movemask_epi8(m) ^ 0xffffffffu;
+    }
+
+    static uint64_t eq_mask(__m256i v, char c)
+    {
+        return (uint32_t)_mm256_movemask_epi8(eq(v, c));
+    }
+
+    static uint64_t bracket_mask(__m256i v)
+    {
+        // Setting 0x20 turns [ and ] into { and }
+        __m256i brace = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+        return (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(eq(brace, '{'), eq(brace, '}'))
+        );
+    }
+};
+
+} // namespace
+
+extern const key_scanner avx2_key_scanner = make_key_scanner<avx2>();
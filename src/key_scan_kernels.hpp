@@ -0,0 +1,285 @@
+#pragma once
+// Key scanning kernels written once for every instruction set. simd has to
+// provide:
+//   size                   bytes in a block
+//   bits                   bits per byte in the masks
+//   load(p)                loads size bytes from p
+//   special_mask(block)    '"', '\\', '\n', '\r' and 0
+//   non_identifier_mask(block)  bytes that aren't [A-Za-z0-9_]
+//   eq_mask(block, c)      bytes equal to c
+//   bracket_mask(block)    '[', ']', '{' and '}'
+// This header is included by translation units compiled for different
+// instruction sets, so everything in it has internal linkage, and it doesn't
+// call inline functions of other headers, whose copies could be merged with
+// ones compiled for another instruction set.
+#include "key_scan.hpp"
+#include <cstddef>
+#include <cstdint>
+
+namespace
+{
+
+inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+
+// Bits of the bytes before the first byte set in mask
+inline uint64_t bits_before_first(uint64_t mask) { return (mask & -mask) - 1; }
+
+inline bool ends_string(char c) { return c == '\n' || c == '\r' || c == 0; }
+
+// [A-Za-z0-9_], looked up for the bytes after the last block
+struct identifier_char_table
+{
+    bool table[256] = {};
+
+    constexpr identifier_char_table()
+    {
+        for (int c = 0; c < 256; c++)
+        {
+            table[c] = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+                       (c >= '0' && c <= '9') || c == '_';
+        }
+    }
+};
+
+constexpr identifier_char_table identifier_chars;
+
+inline bool is_identifier_char(char c)
+{
+    return identifier_chars.table[(unsigned char)c];
+}
+
+template <typename simd> raw_key scan_padded_key(const char *s)
+{
+    const char *p = s;
+    bool identifier = !is_digit(*s);
+    while (true)
+    {
+        auto block = simd::load(p);
+        uint64_t special = simd::special_mask(block);
+        uint64_t other = simd::non_identifier_mask(block);
+        if (special == 0)
+        {
+            identifier = identifier && other == 0;
+            p += simd::size;
+            continue;
+        }
+        identifier = identifier && (other & bits_before_first(special)) == 0;
+        size_t i = __builtin_ctzll(special) / simd::bits;
+        if (p[i] == '"')
+        {
+            int length = p + i - s;
+            return {length, identifier && length > 0};
+        }
+        // An escape or the end of the line
+        if (p[i] != '\\' || ends_string(p[i + 1]))
+        {
+            return {-1, false};
+        }
+        identifier = false;
+        p += i + 2;
+    }
+}
+
+template <typename simd> int string_length(string_view str)
+{
+    const char *p = str.data();
+    const char *end = str.data() + str.size();
+    while (end - p >= (ptrdiff_t)simd::size)
+    {
+        uint64_t special = simd::special_mask(simd::load(p));
+        if (special == 0)
+        {
+            p += simd::size;
+            continue;
+        }
+        size_t i = __builtin_ctzll(special) / simd::bits;
+        if (p[i] == '"')
+        {
+            return p + i - str.data();
+        }
+        if (p[i] != '\\' || p + i + 1 == end || ends_string(p[i + 1]))
+        {
+            return -1;
+        }
+        p += i + 2;
+    }
+    // The rest is shorter than a block
+    while (p < end)
+    {
+        if (*p == '"')
+        {
+            return p - str.data();
+        }
+        if (ends_string(*p) || (*p == '\\' && (++p == end || ends_string(*p))))
+        {
+            return -1;
+        }
+        p++;
+    }
+    return -1;
+}
+
+template <typename simd> bool is_identifier(string_view s)
+{
+    if (s.empty() || is_digit(s[0]))
+    {
+        return false;
+    }
+    const char *p = s.data();
+    const char *end = s.data() + s.size();
+    for (; end - p >= (ptrdiff_t)simd::size; p += simd::size)
+    {
+        if (simd::non_identifier_mask(simd::load(p)) != 0)
+        {
+            return false;
+        }
+    }
+    for (; p < end; p++)
+    {
+        if (!is_identifier_char(*p))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Follows the byte at s[i] for nested_end. escaped is the position of the
+// byte after a backslash in a string, which is skipped. Returns true if the
+// byte closes the container.
+inline bool nesting_step(
+    const char *s,
+    size_t i,
+    size_t &escaped,
+    int &depth,
+    bool &in_string
+)
+{
+    if (i == escaped)
+    {
+        return false;
+    }
+    char c = s[i];
+    if (in_string)
+    {
+        if (c == '\\')
+        {
+            escaped = i + 1;
+        }
+        else if (c == '"')
+        {
+            in_string = false;
+        }
+        return false;
+    }
+    switch (c)
+    {
+    case '"':
+        in_string = true;
+        return false;
+    case '[':
+    case '{':
+        depth++;
+        return false;
+    case ']':
+    case '}':
+        return --depth == 0;
+    default:
+        return false;
+    }
+}
+
+// nested_end from byte i of s on, one byte at a time
+inline size_t nested_end_from(
+    string_view s,
+    size_t i,
+    size_t escaped,
+    int &depth,
+    bool &in_string,
+    bool &in_escape
+)
+{
+    for (; i < s.size(); i++)
+    {
+        if (nesting_step(s.data(), i, escaped, depth, in_string))
+        {
+            in_escape = false;
+            return i + 1;
+        }
+    }
+    in_escape = escaped == s.size();
+    return s.size();
+}
+
+// Sets every bit from each set bit of x up to the next one, in the low
+// width bits, so the bits from an opening quote up to its closing quote are
+// set.
+template <int width> uint64_t prefix_xor(uint64_t x)
+{
+    for (int shift = 1; shift < width; shift *= 2)
+    {
+        x ^= x << shift;
+    }
+    return x;
+}
+
+template <typename simd>
+size_t nested_end(string_view s, int &depth, bool &in_string, bool &in_escape)
+{
+    // One bit of each byte in the masks
+    const uint64_t byte_bits = simd::bits == 1 ? ~uint64_t(0)
+                                               : 0x1111111111111111ull;
+    const char *p = s.data();
+    size_t escaped = in_escape ? 0 : SIZE_MAX;
+    size_t i = 0;
+    for (; s.size() - i >= simd::size; i += simd::size)
+    {
+        auto block = simd::load(p + i);
+        uint64_t quotes = simd::eq_mask(block, '"') & byte_bits;
+        uint64_t brackets = simd::bracket_mask(block) & byte_bits;
+        uint64_t backslashes = simd::eq_mask(block, '\\') & byte_bits;
+        if (backslashes != 0 || escaped == i)
+        {
+            // Escapes are followed a byte at a time
+            for (uint64_t mask = quotes | brackets | backslashes; mask != 0;
+                 mask &= mask - 1)
+            {
+                size_t j = i + __builtin_ctzll(mask) / simd::bits;
+                if (nesting_step(p, j, escaped, depth, in_string))
+                {
+                    in_escape = false;
+                    return j + 1;
+                }
+            }
+            continue;
+        }
+        // Brackets outside of strings
+        uint64_t strings = prefix_xor<simd::size * simd::bits>(quotes) ^
+                           (in_string ? ~uint64_t(0) : 0);
+        for (uint64_t mask = brackets & ~strings; mask != 0; mask &= mask - 1)
+        {
+            size_t j = i + __builtin_ctzll(mask) / simd::bits;
+            if (p[j] == '[' || p[j] == '{')
+            {
+                depth++;
+            }
+            else if (--depth == 0)
+            {
+                in_string = false;
+                in_escape = false;
+                return j + 1;
+            }
+        }
+        in_string ^= __builtin_popcountll(quotes) & 1;
+    }
+    return nested_end_from(s, i, escaped, depth, in_string, in_escape);
+}
+
+template <typename simd> constexpr key_scanner make_key_scanner()
+{
+    return {
+        simd::name, scan_padded_key<simd>, string_length<simd>,
+        is_identifier<simd>, nested_end<simd>};
+}
+
+} // namespace
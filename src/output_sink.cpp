@@ -0,0 +1,278 @@
+#include "output_sink.hpp"
+#include "batched_print.hpp"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#ifndef _MSC_VER
+#include <sys/mman.h>
+#endif
+#ifdef __linux__
+#include <sys/uio.h>
+#endif
+
+// Writes to a file descriptor. Batches are small for terminals, so output
+// appears promptly, and big for files. Pipes get batches of their capacity,
+// and with vmsplice they are passed the pages of the buffer instead of
+// copies.
+struct fd_sink : output_sink
+{
+    int fd;
+    size_t batch_size = 1 << 20;
+    // Capacity of the pipe while vmsplice is used, 0 once it failed
+    size_t pipe_size = 0;
+    // Capacity of the pipe if anything was passed with vmsplice
+    size_t spliced_pipe_size = 0;
+
+    fd_sink(int fd, bool use_vmsplice = false) : fd(fd)
+    {
+        struct stat st;
+        if (isatty(fd))
+        {
+            batch_size = 1 << 14;
+        }
+        else if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+        {
+            batch_size = 1 << 22;
+        }
+#if defined(__linux__) && defined(F_GETPIPE_SZ)
+        else if (fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode))
+        {
+            // A bigger pipe means fewer, bigger writes
+            fcntl(fd, F_SETPIPE_SZ, 1 << 20);
+            int size = fcntl(fd, F_GETPIPE_SZ);
+            if (size > 0)
+            {
+                batch_size = size;
+                pipe_size = use_vmsplice ? size : 0;
+            }
+        }
+#endif
+    }
+
+    // Pages passed with vmsplice are referenced by the pipe until they are
+    // read, so they can't be modified before that; see reuse_distance(). This
+    // only holds if the reader copies them out with read(): a reader that
+    // splices or tees the pipe onward keeps referencing them, which is why
+    // vmsplice has to be asked for.
+    void write(string_view s) override
+    {
+#ifdef __linux__
+        while (pipe_size > 0 && !s.empty())
+        {
+            struct iovec iov = {(void *)s.data(), s.size()};
+            ssize_t w = vmsplice(fd, &iov, 1, 0);
+            if (w == -1)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                // Not supported here, copy the rest of the output
+                pipe_size = 0;
+                break;
+            }
+            spliced_pipe_size = pipe_size;
+            s.remove_prefix(w);
+        }
+#endif
+        write_all(s, fd);
+    }
+
+    void finish() override
+    {
+        if (fd != 1)
+        {
+            close(fd);
+        }
+    }
+
+    size_t flush_size() const override { return batch_size; }
+
+    // A pipe holds at most its capacity, so a buffer followed by that many
+    // more bytes was read already.
+    size_t reuse_distance() const override { return spliced_pipe_size; }
+};
+
+#ifndef _MSC_VER
+// Copies the output into a memory mapping of the output file, which grows
+// geometrically and is cut to the final size at the end.
+struct mmap_sink : output_sink
+{
+    int fd;
+    char *data = nullptr;
+    size_t size = 0;
+    size_t mapped_len = 0;
+
+    mmap_sink(const std::string &filename)
+    {
+        fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666);
+        if (fd == -1)
+        {
+            cerr << "Failed to open output file: " << filename << "\n";
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    void grow(size_t needed)
+    {
+        size_t new_len = std::max(needed, std::max(mapped_len * 2, size_t(1) << 24));
+        if (data != nullptr)
+        {
+            munmap(data, mapped_len);
+        }
+        if (ftruncate(fd, new_len) != 0)
+        {
+            cerr << "Failed to grow the output file\n";
+            exit(EXIT_FAILURE);
+        }
+        void *p = mmap(nullptr, new_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            cerr << "Failed to map the output file\n";
+            exit(EXIT_FAILURE);
+        }
+        data = (char *)p;
+        mapped_len = new_len;
+    }
+
+    void write(string_view s) override
+    {
+        if (size + s.size() > mapped_len)
+        {
+            grow(size + s.size());
+        }
+        memcpy(data + size, s.data(), s.size());
+        size += s.size();
+    }
+
+    void finish() override
+    {
+        if (data != nullptr)
+        {
+            munmap(data, mapped_len);
+        }
+        if (ftruncate(fd, size) != 0)
+        {
+            cerr << "Failed to truncate the output file\n";
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+    }
+
+    size_t flush_size() const override { return 1 << 22; }
+};
+#endif
+
+// Keeps the whole output in memory and writes it at the end, so that nothing
+// is written if the conversion fails. The content is freed right after it's
+// written, so it's copied to pipes instead of being spliced.
+struct memory_sink : output_sink
+{
+    std::unique_ptr<output_sink> destination;
+    growing_string content;
+
+    memory_sink(std::unique_ptr<output_sink> destination)
+        : destination(std::move(destination))
+    {
+    }
+
+    void write(string_view s) override { content.append(s); }
+
+    void finish() override
+    {
+        destination->write(content.view());
+        destination->finish();
+    }
+
+    size_t flush_size() const override { return 1 << 22; }
+};
+
+// Discards the output and reports its size on standard error, for measuring
+// the conversion without the cost of the output.
+struct null_sink : output_sink
+{
+    size_t count = 0;
+
+    void write(string_view s) override { count += s.size(); }
+
+    void finish() override { cerr << count << " bytes\n"; }
+
+    size_t flush_size() const override { return 1 << 22; }
+};
+
+bool parse_sink_kind(string_view name, sink_kind &kind)
+{
+    if (name == "fd")
+    {
+        kind = sink_kind::fd;
+    }
+    else if (name == "vmsplice")
+    {
+        kind = sink_kind::vmsplice;
+    }
+    else if (name == "mmap")
+    {
+        kind = sink_kind::mmap;
+    }
+    else if (name == "memory")
+    {
+        kind = sink_kind::memory;
+    }
+    else if (name == "null")
+    {
+        kind = sink_kind::null;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+static int open_output_file(const std::string &filename)
+{
+    if (filename.empty())
+    {
+        return 1;
+    }
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd == -1)
+    {
+        cerr << "Failed to open output file: " << filename << "\n";
+        exit(EXIT_FAILURE);
+    }
+    return fd;
+}
+
+std::unique_ptr<output_sink>
+make_output_sink(sink_kind kind, const std::string &filename)
+{
+    switch (kind)
+    {
+    case sink_kind::mmap:
+#ifndef _MSC_VER
+        if (filename.empty())
+        {
+            cerr << "--sink mmap needs an output file (-o FILE)\n";
+            exit(EXIT_FAILURE);
+        }
+        return std::make_unique<mmap_sink>(filename);
+#else
+        cerr << "--sink mmap isn't supported on this platform\n";
+        exit(EXIT_FAILURE);
+#endif
+    case sink_kind::memory:
+        return std::make_unique<memory_sink>(
+            std::make_unique<fd_sink>(open_output_file(filename))
+        );
+    case sink_kind::null:
+        return std::make_unique<null_sink>();
+    case sink_kind::vmsplice:
+        return std::make_unique<fd_sink>(open_output_file(filename), true);
+    case sink_kind::fd:
+    default:
+        return std::make_unique<fd_sink>(open_output_file(filename));
+    }
+}
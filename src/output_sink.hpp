@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+using std::string_view;
+
+// Destination of the output. Sinks are only used by one thread at a time.
+struct output_sink
+{
+    virtual ~output_sink() = default;
+
+    virtual void write(string_view s) = 0;
+
+    // Called once after the last write.
+    virtual void finish() {}
+
+    // Size of the batches that suit this destination: small ones show up
+    // sooner, big ones need fewer calls.
+    virtual size_t flush_size() const { return 1 << 20; }
+
+    // Number of bytes that have to be written after a buffer before its
+    // memory can be reused, for sinks that keep referencing written memory.
+    virtual size_t reuse_distance() const { return 0; }
+};
+
+// Kinds of sinks that can be chosen with --sink
+enum class sink_kind
+{
+    fd,
+    vmsplice,
+    mmap,
+    memory,
+    null
+};
+
+// Returns false if name isn't a sink kind.
+bool parse_sink_kind(string_view name, sink_kind &kind);
+
+// Creates a sink writing to filename, or to standard output if filename is
+// empty. mmap needs a file name.
+std::unique_ptr<output_sink>
+make_output_sink(sink_kind kind, const std::string &filename);
@@ -0,0 +1,98 @@
+#include "output_writer.hpp"
+#include "batched_print.hpp"
+
+output_writer *active_output_writer = nullptr;
+
+output_writer::output_writer(std::unique_ptr<output_sink> sink)
+    : sink(std::move(sink))
+{
+    thread = std::thread([this]() { work(); });
+}
+
+output_writer::~output_writer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    thread.join();
+    sink->finish();
+    // The reader may not have read the last buffers, or may never read them.
+    // Freed memory could be reused and overwritten before that, so they are
+    // left allocated.
+    if (sink->reuse_distance() > 0)
+    {
+        for (auto &s : spliced)
+        {
+            s.buffer.release();
+        }
+    }
+}
+
+void output_writer::submit(growing_string &out)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return queued.size() < max_queued; });
+    std::unique_ptr<growing_string> buffer;
+    if (free_buffers.empty())
+    {
+        buffer = std::make_unique<growing_string>();
+    }
+    else
+    {
+        buffer = std::move(free_buffers.back());
+        free_buffers.pop_back();
+    }
+    buffer->swap(out);
+    queued.push_back(std::move(buffer));
+    cv.notify_all();
+}
+
+void output_writer::drain()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    cv.wait(lock, [&]() { return queued.empty() && !writing; });
+}
+
+void output_writer::write(string_view s)
+{
+    staging.append(s);
+    submit(staging);
+}
+
+void output_writer::work()
+{
+    while (true)
+    {
+        std::unique_ptr<growing_string> buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return !queued.empty() || stopping; });
+            if (queued.empty())
+            {
+                return;
+            }
+            buffer = std::move(queued.front());
+            queued.pop_front();
+            writing = true;
+        }
+        cv.notify_all();
+        sink->write(buffer->view());
+        total_written += buffer->size();
+        spliced.push_back({std::move(buffer), total_written});
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            while (!spliced.empty() &&
+                   spliced.front().end + sink->reuse_distance() <=
+                       total_written)
+            {
+                spliced.front().buffer->erase(0);
+                free_buffers.push_back(std::move(spliced.front().buffer));
+                spliced.pop_front();
+            }
+            writing = false;
+        }
+        cv.notify_all();
+    }
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "growing_string.hpp"
+#include "output_sink.hpp"
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Writes the output to a sink on a separate thread, so that formatting can
+// fill the next buffer while the previous one is being written. At most
+// max_queued full buffers wait for the writer; submitting more blocks until
+// it catches up, which bounds the memory used when the output is slow.
+class output_writer
+{
+  public:
+    static const size_t max_queued = 2;
+
+    output_writer(std::unique_ptr<output_sink> sink);
+    // Writes everything that was submitted and finishes the sink.
+    ~output_writer();
+
+    // Queues the content of out for writing, leaving out empty. The storage
+    // of a buffer that was already written is swapped in, so no bytes are
+    // copied.
+    void submit(growing_string &out);
+
+    // Waits until everything submitted so far is written.
+    void drain();
+
+    // Queues a copy of s, for output that isn't in a buffer that can be
+    // handed over.
+    void write(string_view s);
+
+  private:
+    void work();
+
+    // A written buffer whose memory the sink may still reference
+    struct spliced_buffer
+    {
+        std::unique_ptr<growing_string> buffer;
+        // Bytes written up to the end of the buffer
+        size_t end;
+    };
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::unique_ptr<growing_string>> queued;
+    std::vector<std::unique_ptr<growing_string>> free_buffers;
+    // Set while the writer thread is writing a buffer that left the queue
+    bool writing = false;
+    bool stopping = false;
+    std::unique_ptr<output_sink> sink;
+    growing_string staging;
+    size_t total_written = 0;
+    std::deque<spliced_buffer> spliced;
+    std::thread thread;
+};
+
+// Writer used by batched_print_flush on the main thread, if one was started
+extern output_writer *active_output_writer;
@@ -0,0 +1,144 @@
+#include "parallel.hpp"
+#include "batched_print.hpp"
+#include <algorithm>
+#include <string>
+
+thread_pool::thread_pool(unsigned thread_count)
+{
+    for (unsigned i = 0; i < std::max(thread_count, 1u); i++)
+    {
+        threads.emplace_back([this]() { work(); });
+    }
+}
+
+thread_pool::~thread_pool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+}
+
+void thread_pool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    cv.notify_one();
+}
+
+void thread_pool::work()
+{
+    while (true)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+            {
+                return;
+            }
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+unsigned default_thread_count()
+{
+    return std::max(std::thread::hardware_concurrency(), 1u);
+}
+
+void run_ordered(
+    thread_pool &pool,
+    size_t count,
+    const std::function<void(size_t)> &task,
+    size_t max_pending
+)
+{
+    struct slot
+    {
+        std::vector<std::string> chunks;
+        bool done = false;
+    };
+    if (max_pending == 0)
+    {
+        max_pending = 4 * pool.size();
+    }
+    std::mutex mutex;
+    std::condition_variable cv;
+    // Slots of the tasks from head to submitted
+    std::deque<slot> slots;
+    size_t head = 0, submitted = 0;
+
+    // Output printed before has to come first
+    batched_print_flush();
+    while (head < count)
+    {
+        while (submitted < count && submitted < head + max_pending)
+        {
+            size_t id = submitted++;
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                slots.emplace_back();
+            }
+            pool.submit(
+                [&, id]()
+                {
+                    batched_flush_handler = [&, id](string_view s)
+                    {
+                        {
+                            std::lock_guard<std::mutex> lock(mutex);
+                            slots[id - head].chunks.emplace_back(s);
+                        }
+                        cv.notify_all();
+                    };
+                    task(id);
+                    batched_print_flush();
+                    batched_flush_handler = nullptr;
+                    {
+                        std::lock_guard<std::mutex> lock(mutex);
+                        slots[id - head].done = true;
+                    }
+                    cv.notify_all();
+                }
+            );
+        }
+        std::vector<std::string> chunks;
+        bool done;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(
+                lock,
+                [&]()
+                { return !slots.front().chunks.empty() || slots.front().done; }
+            );
+            chunks.swap(slots.front().chunks);
+            done = slots.front().done;
+            if (done)
+            {
+                slots.pop_front();
+                head++;
+            }
+        }
+        for (auto &chunk : chunks)
+        {
+            if (active_output_writer)
+            {
+                active_output_writer->write(chunk);
+            }
+            else
+            {
+                write_all(chunk);
+            }
+        }
+    }
+}
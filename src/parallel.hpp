@@ -0,0 +1,45 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// A fixed set of worker threads running submitted tasks in submission order.
+class thread_pool
+{
+  public:
+    explicit thread_pool(unsigned thread_count);
+    // Finishes the submitted tasks and stops the workers.
+    ~thread_pool();
+
+    void submit(std::function<void()> task);
+
+    unsigned size() const { return threads.size(); }
+
+  private:
+    void work();
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+};
+
+// Number of worker threads to use when the user didn't specify it
+unsigned default_thread_count();
+
+// Runs task(0) ... task(count - 1) on the pool. Everything a task prints with
+// batched_print is collected and written to standard output in task order,
+// so the output doesn't depend on which task finishes first. Output of the
+// oldest unfinished task is written while it runs; at most max_pending tasks
+// are started ahead of it to bound the memory used by buffered output.
+void run_ordered(
+    thread_pool &pool,
+    size_t count,
+    const std::function<void(size_t)> &task,
+    size_t max_pending = 0
+);
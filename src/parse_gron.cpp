@@ -1,5 +1,6 @@
 #include "parse_gron.hpp"
 #include "jsonutils.hpp"
+#include "key_scan.hpp"
 #include <stdexcept>
 #include <string_view>
 
@@ -56,7 +57,7 @@ void parse_gron(
 
         // find end of key
         size_t end = 2;
-        size_t len = raw_json_string_length(line.substr(2));
+        size_t len = active_key_scanner->string_length(line.substr(2));
         if (len == -1)
         {
             throw std::runtime_error("Expected \"");
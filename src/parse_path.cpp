@@ -71,11 +71,13 @@ class Parser
     ObjectAccessors parseObjectAccessors()
     {
         ObjectAccessors accessors;
+        accessors.braced = true;
 
         accessors.object_accessors.emplace_back(parseObjectAccessor());
         while (match(','))
         {
-            if (lookAhead(3) == "...")
+            // The last keys may be shorter than ...
+            if (std::string_view(input_).substr(index_, 3) == "...")
             {
                 accessors.echo_others = true;
                 consume(3);
@@ -83,6 +85,10 @@ class Parser
             }
             accessors.object_accessors.emplace_back(parseObjectAccessor());
         }
+        for (size_t i = 0; i < accessors.object_accessors.size(); i++)
+        {
+            accessors.object_accessors[i].position = i;
+        }
         sort(
             accessors.object_accessors.begin(),
             accessors.object_accessors.end(),
@@ -55,6 +55,8 @@ struct ObjectAccessors
 {
     std::vector<ObjectAccessor> object_accessors;
     bool echo_others = false;
+    // Written as .{...}, not as a single .key
+    bool braced = false;
     // TODO: Implement batching later
     void batchOrInsert(ObjectAccessor object_accessor);
 };
@@ -64,6 +66,8 @@ struct ObjectAccessor
     std::string key;
     std::optional<std::string> new_key;
     ValueAccessor value_accessor;
+    // Position in the path expression, as the accessors are sorted by key
+    size_t position = 0;
 
     inline ObjectAccessor() = default;
 
@@ -78,7 +82,8 @@ struct ObjectAccessor
     // move constructor
     inline ObjectAccessor(ObjectAccessor &&other) noexcept
         : key(std::move(other.key)), new_key(std::move(other.new_key)),
-          value_accessor(std::move(other.value_accessor)) {
+          value_accessor(std::move(other.value_accessor)),
+          position(other.position) {
 
           };
 
@@ -90,6 +95,7 @@ struct ObjectAccessor
             key = std::move(other.key);
             new_key = std::move(other.new_key);
             value_accessor = std::move(other.value_accessor);
+            position = other.position;
         }
         return *this;
     }
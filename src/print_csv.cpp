@@ -0,0 +1,366 @@
+#include "print_csv.hpp"
+#include "batched_print.hpp"
+#include "print_filtered_path.hpp"
+#include <algorithm>
+
+// Returns the accessor at the end of path, following keys, slices and all
+// accessors up to a .{...} group.
+static ValueAccessor *last_accessor(ValueAccessor &path)
+{
+    ValueAccessor *next = nullptr;
+    if (auto slice = std::get_if<std::unique_ptr<Slice>>(&path))
+    {
+        next = &(*slice)->value_accessor;
+    }
+    else if (auto all = std::get_if<std::unique_ptr<AllAccessor>>(&path))
+    {
+        next = &(*all)->value_accessor;
+    }
+    else if (auto objects = std::get_if<std::unique_ptr<ObjectAccessors>>(&path))
+    {
+        if (!(*objects)->braced)
+        {
+            next = &(*objects)->object_accessors[0].value_accessor;
+        }
+    }
+    if (next == nullptr || std::holds_alternative<std::monostate>(*next))
+    {
+        return &path;
+    }
+    return last_accessor(*next);
+}
+
+// Sets cell to the text of value: strings unescaped, objects and arrays as
+// minified JSON, and null as nothing.
+static void set_cell(std::string &cell, simdjson::ondemand::value value)
+{
+    switch (value.type())
+    {
+    case simdjson::ondemand::json_type::string:
+        cell = value.get_string().value();
+        break;
+    case simdjson::ondemand::json_type::null:
+        cell.clear();
+        break;
+    case simdjson::ondemand::json_type::array:
+    case simdjson::ondemand::json_type::object:
+    {
+        string_view raw = raw_value(value);
+        size_t len = 0;
+        cell.resize(raw.size());
+        if (simdjson::minify(raw.data(), raw.size(), cell.data(), len))
+        {
+            cerr << "Invalid JSON: " << raw.substr(0, 100) << "\n";
+            exit(EXIT_FAILURE);
+        }
+        cell.resize(len);
+        break;
+    }
+    default:
+        cell = raw_value(value);
+        break;
+    }
+}
+
+// Selects the first value a column's path reaches in a record
+struct cell_visitor : path_visitor
+{
+    std::string &cell;
+    bool found = false;
+
+    cell_visitor(std::string &cell) : cell(cell) {}
+
+    void enter_index(size_t) override {}
+    void enter_key(string_view) override {}
+    void leave() override {}
+
+    void visit(growing_string &, simdjson::ondemand::value value) override
+    {
+        if (!found)
+        {
+            set_cell(cell, value);
+            found = true;
+        }
+    }
+};
+
+struct record_visitor : path_visitor
+{
+    csv_writer &writer;
+
+    record_visitor(csv_writer &writer) : writer(writer) {}
+
+    void enter_index(size_t) override {}
+    void enter_key(string_view) override {}
+    void leave() override {}
+
+    void visit(growing_string &, simdjson::ondemand::value value) override
+    {
+        writer.add_record(value);
+    }
+};
+
+csv_writer::csv_writer(ValueAccessor path, char delimiter, size_t infer_count)
+    : records(std::move(path)), delimiter(delimiter), infer_count(infer_count)
+{
+    ValueAccessor *last = last_accessor(records);
+    if (std::holds_alternative<std::unique_ptr<ObjectAccessors>>(*last) &&
+        std::get<std::unique_ptr<ObjectAccessors>>(*last)->braced &&
+        !std::get<std::unique_ptr<ObjectAccessors>>(*last)->echo_others)
+    {
+        column_accessors = std::move(*last);
+        *last = std::monostate();
+        auto &accessors =
+            std::get<std::unique_ptr<ObjectAccessors>>(column_accessors)
+                ->object_accessors;
+        columns.resize(accessors.size());
+        for (auto &accessor : accessors)
+        {
+            columns[accessor.position] = {
+                accessor.new_key.value_or(accessor.key), accessor.key,
+                &accessor.value_accessor};
+        }
+        for (size_t i = 0; i < columns.size(); i++)
+        {
+            column_index[columns[i].key].push_back(i);
+        }
+    }
+    inferring = columns.empty();
+    cells.resize(columns.size());
+    has_cell.resize(columns.size());
+    if (!inferring)
+    {
+        print_header();
+    }
+}
+
+void csv_writer::print_document(simdjson::ondemand::document_reference doc)
+{
+    auto type = doc.type().value();
+    if (type != simdjson::ondemand::json_type::array &&
+        type != simdjson::ondemand::json_type::object)
+    {
+        if (std::holds_alternative<std::monostate>(records))
+        {
+            cerr << "CSV records have to be objects\n";
+            exit(EXIT_FAILURE);
+        }
+        // Nothing to select in a scalar
+        return;
+    }
+    thread_local growing_string path;
+    path.erase(0);
+    record_visitor visitor(*this);
+    visit_value_accessor(path, records, doc.get_value(), visitor);
+}
+
+void csv_writer::add_record(simdjson::ondemand::value record)
+{
+    if (record.type() != simdjson::ondemand::json_type::object)
+    {
+        cerr << "CSV records have to be objects\n";
+        exit(EXIT_FAILURE);
+    }
+    if (inferring)
+    {
+        auto &fields = held.emplace_back();
+        for (auto field : record.get_object())
+        {
+            std::string key(field.unescaped_key().value());
+            if (column_index.try_emplace(key, 1, columns.size()).second)
+            {
+                columns.push_back({key, key, nullptr});
+            }
+            fields.emplace_back(std::move(key), std::string());
+            set_cell(fields.back().second, field.value());
+        }
+        if (held.size() >= infer_count)
+        {
+            stop_inferring();
+        }
+        return;
+    }
+    for (auto field : record.get_object())
+    {
+        auto it = column_index.find(field.unescaped_key().value());
+        if (it == column_index.end())
+        {
+            continue;
+        }
+        const std::vector<size_t> &indexes = it->second;
+        if (indexes.size() == 1)
+        {
+            if (!has_cell[indexes[0]])
+            {
+                set_column(indexes[0], field.value());
+            }
+            continue;
+        }
+        // A value can only be read once, so one that fills several columns
+        // is parsed again for each of them, as the element of an array
+        thread_local simdjson::ondemand::parser parser;
+        thread_local growing_string text;
+        text.erase(0);
+        for (size_t i : indexes)
+        {
+            if (has_cell[i])
+            {
+                continue;
+            }
+            if (text.size() == 0)
+            {
+                string_view raw = raw_value(field.value());
+                text.reserve_extra(raw.size() + 2 + simdjson::SIMDJSON_PADDING);
+                text.append('[');
+                text.append(raw);
+                text.append(']');
+            }
+            simdjson::ondemand::document doc = parser.iterate(
+                simdjson::padded_string_view(
+                    text.data, text.size(), text.capacity
+                )
+            );
+            for (auto element : doc.get_array())
+            {
+                set_column(i, element.value());
+            }
+        }
+    }
+    print_row();
+}
+
+// Sets the cell of column i to the value its path selects in value
+void csv_writer::set_column(size_t i, simdjson::ondemand::value value)
+{
+    has_cell[i] = true;
+    if (columns[i].accessor == nullptr ||
+        std::holds_alternative<std::monostate>(*columns[i].accessor))
+    {
+        set_cell(cells[i], value);
+    }
+    else
+    {
+        thread_local growing_string path;
+        path.erase(0);
+        cell_visitor visitor(cells[i]);
+        visit_value_accessor(path, *columns[i].accessor, value, visitor);
+        has_cell[i] = visitor.found;
+    }
+}
+
+// Prints the header and the records that were held back
+void csv_writer::stop_inferring()
+{
+    inferring = false;
+    cells.resize(columns.size());
+    has_cell.resize(columns.size());
+    print_header();
+    for (auto &fields : held)
+    {
+        for (auto &field : fields)
+        {
+            // Inferred columns have keys of their own
+            size_t i = column_index.find(field.first)->second[0];
+            if (!has_cell[i])
+            {
+                cells[i].swap(field.second);
+                has_cell[i] = true;
+            }
+        }
+        print_row();
+    }
+    held.clear();
+    held.shrink_to_fit();
+}
+
+void csv_writer::finish()
+{
+    if (inferring)
+    {
+        stop_inferring();
+    }
+    batched_print_flush();
+}
+
+// Appends s to the output, quoted for CSV or escaped for TSV if needed.
+void csv_writer::append_field(std::string_view s)
+{
+    if (delimiter == '\t')
+    {
+        if (s.find_first_of("\t\n\r\\") == std::string_view::npos)
+        {
+            batched_out.append(s);
+            return;
+        }
+        for (char c : s)
+        {
+            switch (c)
+            {
+            case '\t':
+                batched_out.append("\\t");
+                break;
+            case '\n':
+                batched_out.append("\\n");
+                break;
+            case '\r':
+                batched_out.append("\\r");
+                break;
+            case '\\':
+                batched_out.append("\\\\");
+                break;
+            default:
+                batched_out.append(c);
+            }
+        }
+        return;
+    }
+    char special[] = {delimiter, '"', '\n', '\r'};
+    if (s.find_first_of(std::string_view(special, 4)) == std::string_view::npos)
+    {
+        batched_out.append(s);
+        return;
+    }
+    batched_out.append('"');
+    size_t quote;
+    while ((quote = s.find('"')) != std::string_view::npos)
+    {
+        batched_out.append(s.substr(0, quote + 1)).append('"');
+        s.remove_prefix(quote + 1);
+    }
+    batched_out.append(s).append('"');
+}
+
+void csv_writer::print_header()
+{
+    if (columns.empty())
+    {
+        return;
+    }
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        if (i > 0)
+        {
+            batched_out.append(delimiter);
+        }
+        append_field(columns[i].name);
+    }
+    batched_out.append('\n');
+}
+
+void csv_writer::print_row()
+{
+    for (size_t i = 0; i < columns.size(); i++)
+    {
+        if (i > 0)
+        {
+            batched_out.append(delimiter);
+        }
+        if (has_cell[i])
+        {
+            append_field(cells[i]);
+            has_cell[i] = false;
+        }
+    }
+    batched_out.append('\n');
+    batched_print_flush_if_needed();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include "parse_path.hpp"
+#include "simdjson.h"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Writes the records that a path selects as CSV or TSV rows. If the path
+// ends with object accessors, like .results[#].{id,name:user.name}, they are
+// the columns; otherwise the columns are the keys of the first infer_count
+// records, which are held back until the header is known. Keys that only
+// appear in later records are left out.
+class csv_writer
+{
+  public:
+    csv_writer(ValueAccessor path, char delimiter, size_t infer_count);
+
+    // Writes the records selected from a document.
+    void print_document(simdjson::ondemand::document_reference doc);
+
+    // Writes the records that are still held back for inferring columns.
+    void finish();
+
+    // Called for every record the path selects.
+    void add_record(simdjson::ondemand::value record);
+
+  private:
+    struct column
+    {
+        std::string name;
+        // Key in the record, and the path of the value under it
+        std::string key;
+        const ValueAccessor *accessor = nullptr;
+    };
+
+    struct key_hash
+    {
+        using is_transparent = void;
+        size_t operator()(std::string_view s) const
+        {
+            return std::hash<std::string_view>()(s);
+        }
+    };
+
+    void stop_inferring();
+    void set_column(size_t i, simdjson::ondemand::value value);
+    void append_field(std::string_view s);
+    void print_header();
+    void print_row();
+
+    ValueAccessor records;
+    // The accessors that were split off from the end of the path
+    ValueAccessor column_accessors;
+    char delimiter;
+    size_t infer_count;
+    bool inferring;
+    std::vector<column> columns;
+    // Columns of each key, several if the path selects it more than once
+    std::unordered_map<
+        std::string, std::vector<size_t>, key_hash, std::equal_to<>>
+        column_index;
+    // Cells of the current row, and whether they were set
+    std::vector<std::string> cells;
+    std::vector<bool> has_cell;
+    // Keys and cells of the records read while inferring columns
+    std::vector<std::vector<std::pair<std::string, std::string>>> held;
+};
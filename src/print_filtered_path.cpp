@@ -19,16 +19,14 @@ void print_value_accessor(
     growing_string &path,
     const ValueAccessor &valueAccessor,
     simdjson::ondemand::value element,
-    const unsigned flags,
-    vector<string> &filters
+    path_visitor &visitor
 );
 
 void print_slice(
     growing_string &path,
     const Slice &slice,
     simdjson::ondemand::value element,
-    const unsigned flags,
-    vector<string> &filters
+    path_visitor &visitor
 )
 {
     int start = slice.start;
@@ -56,12 +54,20 @@ void print_slice(
             if (index >= start && (index < end) &&
                 (slice.step == 1 || (index - start) % slice.step == 0))
             {
-                path.append("[");
-                path.append(std::to_string(index));
-                path.append("]");
+                if (slice.append_index)
+                {
+                    path.append("[");
+                    path.append(std::to_string(index));
+                    path.append("]");
+                    visitor.enter_index(index);
+                }
                 print_value_accessor(
-                    path, slice.value_accessor, child.value(), flags, filters
+                    path, slice.value_accessor, child.value(), visitor
                 );
+                if (slice.append_index)
+                {
+                    visitor.leave();
+                }
                 path.erase(path_size);
             }
             index++;
@@ -79,8 +85,7 @@ void print_object_accessors(
     growing_string &path,
     const ObjectAccessors &objectAccessors,
     simdjson::ondemand::value element,
-    const unsigned flags,
-    vector<string> &filters
+    path_visitor &visitor
 )
 {
     int path_size = path.size();
@@ -100,7 +105,7 @@ void print_object_accessors(
                     string key_to_use =
                         objectAccessor.new_key.value_or(objectAccessor.key);
 
-                    if (is_js_identifier(key_to_use))
+                    if (active_key_scanner->is_identifier(key_to_use))
                     {
                         path.append(".");
                         path.append(key_to_use);
@@ -112,10 +117,12 @@ void print_object_accessors(
                         path.append("\"]");
                     }
 
+                    visitor.enter_key(key_to_use);
                     print_value_accessor(
                         path, objectAccessor.value_accessor, field.value(),
-                        flags, filters
+                        visitor
                     );
+                    visitor.leave();
 
                     path.erase(path_size);
 
@@ -125,7 +132,7 @@ void print_object_accessors(
 
             if (!foundMatch && objectAccessors.echo_others)
             {
-                if (is_js_identifier(key))
+                if (active_key_scanner->is_identifier(key))
                 {
                     path.append(".");
                     path.append(key);
@@ -137,9 +144,9 @@ void print_object_accessors(
                     path.append("\"]");
                 }
 
-                recursive_print_gron(
-                    field.value(), path, batched_out, flags, filters
-                );
+                visitor.enter_key(key);
+                visitor.visit(path, field.value());
+                visitor.leave();
 
                 path.erase(path_size);
             }
@@ -155,8 +162,7 @@ void print_all_accessor(
     growing_string &path,
     const AllAccessor &allAccessor,
     simdjson::ondemand::value element,
-    const unsigned flags,
-    vector<string> &filters
+    path_visitor &visitor
 )
 {
     if (element.type() == simdjson::ondemand::json_type::array)
@@ -167,11 +173,13 @@ void print_all_accessor(
         for (auto child : array)
         {
             path.append("[");
-            path.append(std::to_string(index++));
+            path.append(std::to_string(index));
             path.append("]");
+            visitor.enter_index(index++);
             print_value_accessor(
-                path, allAccessor.value_accessor, child.value(), flags, filters
+                path, allAccessor.value_accessor, child.value(), visitor
             );
+            visitor.leave();
             path.erase(path_size);
         }
     }
@@ -183,7 +191,7 @@ void print_all_accessor(
         {
             string_view key = field.unescaped_key().value();
 
-            if (is_js_identifier(key))
+            if (active_key_scanner->is_identifier(key))
             {
                 path.append(".");
                 path.append(key);
@@ -195,9 +203,11 @@ void print_all_accessor(
                 path.append("\"]");
             }
 
+            visitor.enter_key(key);
             print_value_accessor(
-                path, allAccessor.value_accessor, field.value(), flags, filters
+                path, allAccessor.value_accessor, field.value(), visitor
             );
+            visitor.leave();
             path.erase(path_size);
         }
     }
@@ -213,20 +223,19 @@ void print_value_accessor(
     growing_string &path,
     const ValueAccessor &valueAccessor,
     simdjson::ondemand::value element,
-    const unsigned flags,
-    vector<string> &filters
+    path_visitor &visitor
 )
 {
     if (std::holds_alternative<std::monostate>(valueAccessor))
     {
-        // No value accessor present, print the element
-        recursive_print_gron(element, path, batched_out, flags, filters);
+        // No value accessor present, the element is selected
+        visitor.visit(path, element);
     }
     else if (std::holds_alternative<std::unique_ptr<Slice>>(valueAccessor))
     {
         // Value accessor is a slice, handle it
         const auto &slicePtr = std::get<std::unique_ptr<Slice>>(valueAccessor);
-        print_slice(path, *slicePtr, element, flags, filters);
+        print_slice(path, *slicePtr, element, visitor);
     }
     else if (std::holds_alternative<std::unique_ptr<ObjectAccessors>>(
                  valueAccessor
@@ -235,9 +244,7 @@ void print_value_accessor(
         // Value accessor is a set of object accessors, handle it
         const auto &objectAccessorsPtr =
             std::get<std::unique_ptr<ObjectAccessors>>(valueAccessor);
-        print_object_accessors(
-            path, *objectAccessorsPtr, element, flags, filters
-        );
+        print_object_accessors(path, *objectAccessorsPtr, element, visitor);
     }
     else if (std::holds_alternative<std::unique_ptr<AllAccessor>>(
                  valueAccessor
@@ -246,7 +253,7 @@ void print_value_accessor(
         // Value accessor is an all accessor, handle it
         const auto &allAccessorPtr =
             std::get<std::unique_ptr<AllAccessor>>(valueAccessor);
-        print_all_accessor(path, *allAccessorPtr, element, flags, filters);
+        print_all_accessor(path, *allAccessorPtr, element, visitor);
     }
     else
     {
@@ -254,16 +261,303 @@ void print_value_accessor(
     }
 }
 
-void print_filtered_path(
+void visit_value_accessor(
+    growing_string &path,
+    const ValueAccessor &accessor,
+    simdjson::ondemand::value element,
+    path_visitor &visitor
+)
+{
+    print_value_accessor(path, accessor, element, visitor);
+}
+
+void visit_filtered_path(
     growing_string &path,
     int processed,
     simdjson::ondemand::value element,
-    const unsigned flags,
-    vector<string> &filters
+    path_visitor &visitor
 )
 {
     string_view input = path.view().substr(processed);
     ValueAccessor valueAccessor = parse_path(input);
     path.erase(processed);
-    print_value_accessor(path, valueAccessor, element, flags, filters);
+    print_value_accessor(path, valueAccessor, element, visitor);
+}
+
+// Prints every selected value as gron under its path
+struct gron_path_visitor : path_visitor
+{
+    const unsigned flags;
+    vector<string> &filters;
+
+    gron_path_visitor(const unsigned flags, vector<string> &filters)
+        : flags(flags), filters(filters)
+    {
+    }
+
+    void enter_index(size_t) override {}
+    void enter_key(string_view) override {}
+    void leave() override {}
+
+    void visit(growing_string &path, simdjson::ondemand::value value) override
+    {
+        recursive_print_gron(value, path, batched_out, flags, filters);
+    }
+};
+
+void print_filtered_path(
+    growing_string &path,
+    int processed,
+    simdjson::ondemand::value element,
+    const unsigned flags,
+    vector<string> &filters
+)
+{
+    gron_path_visitor visitor(flags, filters);
+    visit_filtered_path(path, processed, element, visitor);
+}
+
+string_view raw_value(simdjson::ondemand::value value)
+{
+    switch (value.type())
+    {
+    case simdjson::ondemand::json_type::array:
+        return value.get_array().value().raw_json();
+    case simdjson::ondemand::json_type::object:
+        return value.get_object().value().raw_json();
+    default:
+    {
+        string_view token = value.raw_json_token();
+        while (!token.empty() &&
+               (token.back() == ' ' || token.back() == '\n' ||
+                token.back() == '\r' || token.back() == '\t'))
+        {
+            token.remove_suffix(1);
+        }
+        return token;
+    }
+    }
+}
+
+static void append_json_string(growing_string &out, string_view s)
+{
+    static const char hex[] = "0123456789abcdef";
+    out.append('"');
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out.append('\\').append(c);
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            out.append("\\u00").append(hex[c >> 4]).append(hex[c & 15]);
+        }
+        else
+        {
+            out.append(c);
+        }
+    }
+    out.append('"');
+}
+
+// Writes the selected values into the objects and arrays that lead to them.
+// A container is only opened when the first value inside it is selected, so
+// paths that select nothing leave no trace.
+struct json_path_visitor : path_visitor
+{
+    // Key or index that was entered
+    struct step
+    {
+        bool is_index;
+        size_t index;
+        string key;
+        // Set when the key or index was written to its container
+        bool written = false;
+    };
+    // An open object or array, holding the steps at its depth
+    struct container
+    {
+        bool is_array;
+        size_t count = 0;
+        // Index of the next array element to write
+        size_t next_index = 0;
+    };
+
+    const unsigned flags;
+    vector<step> steps;
+    vector<container> containers;
+    bool selected_any = false;
+
+    json_path_visitor(const unsigned flags) : flags(flags) {}
+
+    void enter_index(size_t index) override
+    {
+        steps.push_back({true, index, string()});
+    }
+
+    void enter_key(string_view key) override
+    {
+        steps.push_back({false, 0, string(key)});
+    }
+
+    void leave() override
+    {
+        close_containers(steps.size());
+        steps.pop_back();
+    }
+
+    void visit(growing_string &, simdjson::ondemand::value value) override
+    {
+        for (size_t depth = 0; depth < steps.size(); depth++)
+        {
+            write_step(depth);
+        }
+        batched_out.append(raw_value(value));
+        selected_any = true;
+        batched_print_flush_if_needed();
+    }
+
+    void finish()
+    {
+        close_containers(0);
+        if (selected_any)
+        {
+            batched_print("\n");
+        }
+    }
+
+    void new_line(size_t depth)
+    {
+        if (flags & NEWLINE)
+        {
+            batched_out.append('\n');
+        }
+        if (flags & INDENT)
+        {
+            for (size_t i = 0; i < depth; i++)
+            {
+                batched_out.append("  ");
+            }
+        }
+    }
+
+    // Opens the container of steps[depth] if needed and writes the key or
+    // the index of the step into it.
+    void write_step(size_t depth)
+    {
+        step &s = steps[depth];
+        if (s.written)
+        {
+            return;
+        }
+        if (containers.size() == depth)
+        {
+            containers.push_back({s.is_index});
+            batched_out.append(s.is_index ? '[' : '{');
+        }
+        container &c = containers[depth];
+        if (s.is_index)
+        {
+            // Keep the indexes of the input
+            for (; c.next_index < s.index; c.next_index++)
+            {
+                separate(c, depth);
+                batched_out.append("null");
+            }
+            c.next_index = s.index + 1;
+            separate(c, depth);
+        }
+        else
+        {
+            separate(c, depth);
+            append_json_string(batched_out, s.key);
+            batched_out.append(": ");
+        }
+        s.written = true;
+    }
+
+    void separate(container &c, size_t depth)
+    {
+        if (c.count++ > 0)
+        {
+            batched_out.append(',');
+        }
+        new_line(depth + 1);
+    }
+
+    // Closes the containers from depth on.
+    void close_containers(size_t depth)
+    {
+        while (containers.size() > depth)
+        {
+            bool is_array = containers.back().is_array;
+            containers.pop_back();
+            new_line(containers.size());
+            batched_out.append(is_array ? ']' : '}');
+        }
+    }
+};
+
+void print_filtered_path_json(
+    growing_string &path,
+    int processed,
+    simdjson::ondemand::value element,
+    const unsigned flags
+)
+{
+    json_path_visitor visitor(flags);
+    visit_filtered_path(path, processed, element, visitor);
+    visitor.finish();
+}
+
+// Appends the minified JSON text of raw to batched_out.
+static void append_minified(string_view raw)
+{
+    batched_out.reserve_extra(raw.size());
+    size_t len = 0;
+    if (simdjson::minify(raw.data(), raw.size(), batched_out.data + batched_out.len, len))
+    {
+        exit_with_error("Invalid JSON: " + string(raw.substr(0, 100)));
+    }
+    batched_out.len += len;
+}
+
+// Prints every selected value on a line of its own
+struct ndjson_path_visitor : path_visitor
+{
+    void enter_index(size_t) override {}
+    void enter_key(string_view) override {}
+    void leave() override {}
+
+    void visit(growing_string &, simdjson::ondemand::value value) override
+    {
+        append_minified(raw_value(value));
+        batched_print('\n');
+    }
+};
+
+void print_filtered_path_ndjson(
+    const ValueAccessor &accessor,
+    simdjson::ondemand::document_reference doc
+)
+{
+    if (std::holds_alternative<std::monostate>(accessor))
+    {
+        // The whole document, which may be a scalar
+        append_minified(doc.raw_json());
+        batched_print('\n');
+        return;
+    }
+    auto type = doc.type().value();
+    if (type != simdjson::ondemand::json_type::array &&
+        type != simdjson::ondemand::json_type::object)
+    {
+        // Nothing to select in a scalar
+        return;
+    }
+    thread_local growing_string path;
+    path.erase(0);
+    ndjson_path_visitor visitor;
+    print_value_accessor(path, accessor, doc.get_value(), visitor);
 }
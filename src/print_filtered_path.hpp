@@ -2,9 +2,45 @@
 #include "batched_print.hpp"
 #include "growing_string.hpp"
 #include "jsonutils.hpp"
+#include "parse_path.hpp"
 #include "print_gron.hpp"
 #include "simdjson.h"
 
+// Receives what a path expression selects from a document. Every selected
+// value is reported with the keys and array indexes leading to it, which are
+// entered and left like a depth-first traversal of the output tree.
+struct path_visitor
+{
+    virtual ~path_visitor() = default;
+    virtual void enter_index(size_t index) = 0;
+    // key is unescaped
+    virtual void enter_key(string_view key) = 0;
+    virtual void leave() = 0;
+    // path is the gron path of the value
+    virtual void visit(growing_string &path, simdjson::ondemand::value value) = 0;
+};
+
+// Evaluates the path expression that follows the first processed bytes of
+// path on element, which is at the path given by those bytes.
+void visit_filtered_path(
+    growing_string &path,
+    int processed,
+    simdjson::ondemand::value element,
+    path_visitor &visitor
+);
+
+// Evaluates a parsed path expression on element, which is at path.
+void visit_value_accessor(
+    growing_string &path,
+    const ValueAccessor &accessor,
+    simdjson::ondemand::value element,
+    path_visitor &visitor
+);
+
+// Returns the JSON text of value as it is in the input.
+string_view raw_value(simdjson::ondemand::value value);
+
+// Prints the selected values as gron.
 void print_filtered_path(
     growing_string &path,
     int processed,
@@ -12,3 +48,21 @@ void print_filtered_path(
     const unsigned flags,
     vector<string> &filters
 );
+
+// Prints the selected values as one JSON document. The selected values are
+// copied from the input as they are, and only the objects and arrays leading
+// to them are written. Array elements skipped before a selected one are
+// written as null, so the indexes stay the same.
+void print_filtered_path_json(
+    growing_string &path,
+    int processed,
+    simdjson::ondemand::value element,
+    const unsigned flags
+);
+
+// Prints every value selected from doc as minified JSON on a line of its own,
+// without building the paths leading to them.
+void print_filtered_path_ndjson(
+    const ValueAccessor &accessor,
+    simdjson::ondemand::document_reference doc
+);
@@ -1,5 +1,6 @@
 #include "print_gron.hpp"
 #include "simdjson.h"
+#include <deque>
 
 inline char *print_equals(char *ptr, const unsigned flags)
 {
@@ -16,247 +17,447 @@ inline char *print_equals(char *ptr, const unsigned flags)
     return ptr;
 }
 
-void recursive_print_gron(
-    simdjson::ondemand::value element,
+void print_gron_leaf(
     growing_string &path,
+    simdjson::ondemand::json_type type,
+    string_view s,
     growing_string &out_growing_string,
     const unsigned flags,
     vector<string> &filters
 )
 {
-    switch (element.type())
+    size_t orig_out_len = out_growing_string.size();
+    size_t path_size = path.size();
+    out_growing_string.reserve_extra(
+        path_size + orig_out_len + s.length() + 30
+    );
+    char *ptr = &out_growing_string.data[orig_out_len];
+    if (!(flags & VALUES_ONLY))
+    {
+        memcpy(ptr, path.data, path_size);
+        ptr += path_size;
+    }
+    if (flags & PATHS_ONLY)
     {
-    case simdjson::ondemand::json_type::array:
+        s = string_view();
+    }
+    else if (!(flags & VALUES_ONLY))
     {
-        size_t orig_base_len = path.size();
-        if (flags & SPACES)
-            if (flags & COLOR)
-                path.append(" = \033[1;34m[]\033[0m");
-            else
-                path.append(" = []");
-        else if (flags & COLOR)
-            path.append("=\033[1;34m[]\033[0m");
-        else
-            path.append("=[]");
-
-        if (flags & SEMICOLON)
+        ptr = print_equals(ptr, flags);
+    }
+    if ((flags & COLOR) && !(flags & PATHS_ONLY))
+    {
+        *ptr++ = '\033';
+        *ptr++ = '[';
+        *ptr++ = '1';
+        *ptr++ = ';';
+        *ptr++ = '3';
+        if (type == simdjson::ondemand::json_type::number)
         {
-            path.append(';');
+            *ptr++ = '1';
         }
-        path.append('\n');
-        gprint(path, out_growing_string, flags, filters);
-        path.erase(orig_base_len);
-        uint64_t index = 0;
-        if (flags & COLOR)
-            path.append("\033[1;34m[\033[1;32m");
-        else
-            path.append("[");
-        size_t base_len = path.size();
-        char out[100];
-
-        for (auto child : element.get_array())
+        else if (type == simdjson::ondemand::json_type::string)
         {
-            auto end = simdjson::fast_itoa(out, index++);
-            path.append(string_view(out, end - out));
-            if (flags & COLOR)
-                path.append("\033[1;34m]\033[0m");
-            else
-                path.append("]");
-            recursive_print_gron(
-                child.value(), path, out_growing_string, flags, filters
-            );
-            path.erase(base_len);
+            *ptr++ = '2';
         }
-        path.erase(orig_base_len);
-        break;
+        else if (type == simdjson::ondemand::json_type::boolean)
+        {
+            *ptr++ = '3';
+        }
+        else if (type == simdjson::ondemand::json_type::null)
+        {
+            *ptr++ = '0';
+        }
+        *ptr++ = 'm';
     }
-    case simdjson::ondemand::json_type::object:
+    while (s.size() > 0 &&
+           (s[s.size() - 1] == ' ' || s[s.size() - 1] == '\n' ||
+            s[s.size() - 1] == '\r' || s[s.size() - 1] == '\t'))
     {
-        size_t base_len = path.size();
-        if (flags & SPACES)
-            if (flags & COLOR)
-                path.append(" = \033[1;34m{}\033[0m");
-            else
-                path.append(" = {}");
-        else if (flags & COLOR)
-            path.append("=\033[1;34m{}\033[0m");
-        else
-            path.append("={}");
-        if (flags & SEMICOLON)
+        s.remove_suffix(1);
+    }
+    memcpy(ptr, s.data(), s.size());
+    ptr += s.size();
+    if ((flags & COLOR) && !(flags & PATHS_ONLY))
+    {
+        *ptr++ = '\033';
+        *ptr++ = '[';
+        *ptr++ = '0';
+        *ptr++ = 'm';
+    }
+    if ((flags & SEMICOLON) && !(flags & (PATHS_ONLY | VALUES_ONLY)))
+    {
+        *ptr++ = ';';
+    }
+    *ptr++ = '\n';
+    string_view ss = string_view(
+        &out_growing_string.data[orig_out_len],
+        ptr - &out_growing_string.data[orig_out_len]
+    );
+    if (can_show(ss, flags, filters))
+    {
+        if (flags & COLORIZE_MATCHES)
         {
-            path.append(';');
+            ss = colorize_matches(ss, filters);
+            out_growing_string.append(ss);
         }
-        path.append('\n');
-        gprint(path, out_growing_string, flags, filters);
-        path.erase(base_len);
-        // fastgron can directly stream results to out_growing_string if we
-        // don't need to sort the output
-        if (flags & SORT_OUTPUT)
+        else if (flags & PREFIX_DELTA)
         {
-            std::vector<std::pair<string, string>> fields;
-            growing_string out2;
-            for (auto field : element.get_object())
-            {
-                auto key_orig = field.key();
-                auto key_value_raw = key_orig.value().raw();
-                auto key = string_view(
-                    key_value_raw, raw_json_string_length(key_value_raw)
-                );
+            // Replace the shared part of the path with its length. The
+            // number can be longer than what it replaces, hence the move.
+            size_t shared = path.unchanged_len;
+            char num[24];
+            char *end = simdjson::fast_itoa(num, shared);
+            size_t num_len = end - num;
+            char *line = &out_growing_string.data[orig_out_len];
+            memmove(line + num_len + 1, line + shared, ss.size() - shared);
+            memcpy(line, num, num_len);
+            line[num_len] = ' ';
+            out_growing_string.len =
+                orig_out_len + num_len + 1 + ss.size() - shared;
+            path.unchanged_len = path_size;
+        }
+        else
+        {
+            out_growing_string.len = ptr - &out_growing_string.data[0];
+        }
+    }
+}
 
-                string key_str(key);
-                if (!is_js_identifier(key))
-                {
-                    if (flags & COLOR)
-                        path.append("\033[1;34m[\033[1;35m\"");
-                    else
-                        path.append("[\"");
-                    path.append(key);
+// A key of an object and the part of the path it was printed as
+struct cached_key
+{
+    string raw;
+    string part;
 
-                    if (flags & COLOR)
-                        path.append("\"\033[1;34m]\033[0m");
-                    else
-                        path.append("\"]");
-                }
-                else
-                {
-                    path.append(".");
-                    if (flags & COLOR)
-                        path.append("\033[1;34m");
-                    path.append(key);
-                    if (flags & COLOR)
-                        path.append("\033[0m");
-                }
-                recursive_print_gron(field.value(), path, out2, flags, filters);
-                path.erase(base_len);
-                fields.emplace_back(key_str, string(out2));
-                out2.erase(0);
-            }
-            std::sort(
-                fields.begin(), fields.end(),
-                [](auto &a, auto &b) { return a.first < b.first; }
-            );
-            for (auto &field : fields)
+    // Whether the raw key at s is the same. Keys are in the padded document,
+    // so short ones can be compared without finding their end first.
+    bool matches(const char *s) const
+    {
+        return raw.size() < simdjson::SIMDJSON_PADDING &&
+               memcmp(s, raw.data(), raw.size()) == 0 && s[raw.size()] == '"';
+    }
+};
+
+// A container that recursive_print_gron is walking
+struct gron_frame
+{
+    bool is_array;
+    // Whether the iterator is at a child container that was printed since
+    bool started;
+    simdjson::ondemand::array_iterator array_it, array_end;
+    simdjson::ondemand::object_iterator object_it, object_end;
+    // Path length before the container, and before each child's part
+    size_t orig_len;
+    size_t base_len;
+    uint64_t index;
+    // Length of the index at the end of the path
+    size_t digits;
+    // Keys of the last object walked at this depth and the index of the
+    // current one. The objects of an array usually have the same keys in
+    // the same order, and then their path parts are reused.
+    std::vector<cached_key> shape;
+    size_t field;
+    // Where the container's lines go
+    growing_string *out;
+    // For SORT_OUTPUT, the key of the current field, its lines and the
+    // lines of the fields before it
+    bool sorted;
+    string key;
+    growing_string sorted_out;
+    std::vector<std::pair<string, string>> fields;
+};
+
+// Adds one to the index of digits bytes at base_len in path, in place.
+// Returns false if the index needs one more digit.
+inline bool increment_index(growing_string &path, size_t base_len, size_t digits)
+{
+    char *d = path.data + base_len;
+    size_t i = digits;
+    while (i > 0 && d[i - 1] == '9')
+    {
+        i--;
+    }
+    if (i == 0)
+    {
+        return false;
+    }
+    d = path.modify(base_len);
+    d[i - 1]++;
+    memset(d + i, '0', digits - i);
+    return true;
+}
+
+// Sets shape[i] to key and its path part
+inline void
+cache_key(std::vector<cached_key> &shape, size_t i, string_view key, string_view part)
+{
+    if (i == shape.size())
+    {
+        shape.emplace_back();
+    }
+    shape[i].raw = key;
+    shape[i].part = part;
+}
+
+inline bool is_container(simdjson::ondemand::json_type type)
+{
+    return type == simdjson::ondemand::json_type::array ||
+           type == simdjson::ondemand::json_type::object;
+}
+
+// Walks element with a stack of containers instead of recursion, so deep
+// nesting doesn't overflow the call stack. The scalars of a container are
+// printed in a loop of their own, so only containers go through the stack.
+void recursive_print_gron(
+    simdjson::ondemand::value element,
+    growing_string &path,
+    growing_string &out_growing_string,
+    const unsigned flags,
+    vector<string> &filters
+)
+{
+    // VALUES_ONLY doesn't need the paths, unless the keys are sorted
+    const bool build_path = !(flags & VALUES_ONLY) || (flags & SORT_OUTPUT);
+    // Frames are reused between documents, and a deque doesn't move them,
+    // so the out pointers stay valid.
+    thread_local std::deque<gron_frame> frames;
+    size_t depth = 0;
+
+    auto print_scalar = [&](simdjson::ondemand::value value,
+                            simdjson::ondemand::json_type type,
+                            growing_string &out)
+    {
+        // The value is skipped by the parent if it's not read
+        print_gron_leaf(
+            path, type,
+            (flags & PATHS_ONLY) ? string_view() : value.raw_json_token(), out,
+            flags, filters
+        );
+        batched_print_flush_if_needed();
+    };
+
+    // Starts walking a container whose lines go to out
+    auto push = [&](simdjson::ondemand::value value,
+                    simdjson::ondemand::json_type type, growing_string &out)
+    {
+        if (depth == frames.size())
+        {
+            frames.emplace_back();
+        }
+        gron_frame &frame = frames[depth++];
+        frame.is_array = type == simdjson::ondemand::json_type::array;
+        frame.started = false;
+        frame.orig_len = path.size();
+        frame.out = &out;
+        frame.sorted = false;
+        if (build_path)
+        {
+            print_container_init(path, frame.is_array, out, flags, filters);
+        }
+        if (frame.is_array)
+        {
+            if (build_path)
             {
-                out_growing_string.append(field.second);
+                if (flags & COLOR)
+                    path.append("\033[1;34m[\033[1;32m");
+                else
+                    path.append("[");
             }
+            frame.index = 0;
+            auto array = value.get_array().value();
+            frame.array_it = array.begin().value();
+            frame.array_end = array.end().value();
         }
         else
         {
+            // fastgron can directly stream results to out if we don't need
+            // to sort the output
+            frame.sorted = flags & SORT_OUTPUT;
+            if (frame.sorted)
+            {
+                frame.fields.clear();
+                frame.sorted_out.erase(0);
+            }
+            frame.field = 0;
+            auto object = value.get_object().value();
+            frame.object_it = object.begin().value();
+            frame.object_end = object.end().value();
+        }
+        frame.base_len = path.size();
+    };
+
+    // Moves the lines of the current field of a sorted object to its fields
+    auto add_sorted_field = [](gron_frame &frame)
+    {
+        frame.fields.emplace_back(
+            std::move(frame.key), string(frame.sorted_out)
+        );
+        frame.sorted_out.erase(0);
+    };
 
-            for (auto field : element.get_object())
+    auto type = element.type().value();
+    if (!is_container(type))
+    {
+        print_scalar(element, type, out_growing_string);
+        return;
+    }
+    push(element, type, out_growing_string);
+    while (depth > 0)
+    {
+        gron_frame &frame = frames[depth - 1];
+        // Kept in locals, since the compiler can't tell that printing
+        // doesn't change the frame
+        const size_t base_len = frame.base_len;
+        bool pushed = false;
+        if (frame.is_array)
+        {
+            growing_string &out = *frame.out;
+            auto it = frame.array_it;
+            uint64_t index = frame.index;
+            size_t digits = frame.digits;
+            if (frame.started)
+            {
+                ++it;
+            }
+            for (; it != frame.array_end; ++it)
             {
-                auto key_orig = field.key();
-                auto key_value_raw = key_orig.value().raw();
-                auto key = string_view(
-                    key_value_raw, raw_json_string_length(key_value_raw)
-                );
-                if (!is_js_identifier(key))
+                // The path still ends with the previous index, which is
+                // usually incremented in place
+                if (build_path &&
+                    (index == 0 || !increment_index(path, base_len, digits)))
                 {
+                    char text[24];
+                    auto end = simdjson::fast_itoa(text, index);
+                    digits = end - text;
+                    path.erase(base_len);
+                    path.append(string_view(text, digits));
                     if (flags & COLOR)
-                        path.append("\033[1;34m[\033[1;35m\"");
-                    else
-                        path.append("[\"");
-                    path.append(key);
-                    if (flags & COLOR)
-                        path.append("\"\033[1;34m]\033[0m");
+                        path.append("\033[1;34m]\033[0m");
                     else
-                        path.append("\"]");
+                        path.append("]");
                 }
-                else
+                index++;
+                simdjson::ondemand::value child = (*it).value();
+                auto child_type = child.type().value();
+                if (is_container(child_type))
                 {
-                    path.append(".");
-                    if (flags & COLOR)
-                        path.append("\033[1;34m");
-                    path.append(key);
-                    if (flags & COLOR)
-                        path.append("\033[0m");
+                    frame.array_it = it;
+                    frame.index = index;
+                    frame.digits = digits;
+                    frame.started = true;
+                    push(child, child_type, out);
+                    pushed = true;
+                    break;
                 }
-                recursive_print_gron(
-                    field.value(), path, out_growing_string, flags, filters
-                );
-                path.erase(base_len);
+                print_scalar(child, child_type, out);
             }
         }
-        break;
-    }
-    case simdjson::ondemand::json_type::number:
-    case simdjson::ondemand::json_type::string:
-    case simdjson::ondemand::json_type::boolean:
-    case simdjson::ondemand::json_type::null:
-    {
-        size_t orig_out_len = out_growing_string.size();
-        size_t path_size = path.size();
-        string_view s = element.raw_json_token();
-        out_growing_string.reserve_extra(
-            path_size + orig_out_len + s.length() + 30
-        );
-        char *ptr = &out_growing_string.data[orig_out_len];
-        memcpy(ptr, path.data, path_size);
-        ptr += path_size;
-        ptr = print_equals(ptr, flags);
-        if (flags & COLOR)
+        else
         {
-            *ptr++ = '\033';
-            *ptr++ = '[';
-            *ptr++ = '1';
-            *ptr++ = ';';
-            *ptr++ = '3';
-            if (element.type() == simdjson::ondemand::json_type::number)
-            {
-                *ptr++ = '1';
-            }
-            else if (element.type() == simdjson::ondemand::json_type::string)
-            {
-                *ptr++ = '2';
-            }
-            else if (element.type() == simdjson::ondemand::json_type::boolean)
+            growing_string &out = frame.sorted ? frame.sorted_out : *frame.out;
+            auto it = frame.object_it;
+            size_t field_index = frame.field;
+            if (frame.started)
             {
-                *ptr++ = '3';
+                ++it;
+                if (frame.sorted)
+                {
+                    add_sorted_field(frame);
+                }
             }
-            else if (element.type() == simdjson::ondemand::json_type::null)
+            for (; it != frame.object_end; ++it)
             {
-                *ptr++ = '0';
+                auto field = *it;
+                if (build_path)
+                {
+                    const char *raw = field.key().value().raw();
+                    string_view key;
+                    path.erase(base_len);
+                    if (field_index < frame.shape.size() &&
+                        frame.shape[field_index].matches(raw))
+                    {
+                        key = string_view(raw, frame.shape[field_index].raw.size());
+                        path.append(frame.shape[field_index].part);
+                    }
+                    else
+                    {
+                        // Keys are in the padded document
+                        raw_key scanned = active_key_scanner->scan_padded_key(raw);
+                        key = string_view(raw, scanned.length);
+                        append_object_key(path, key, scanned.identifier, flags);
+                        cache_key(
+                            frame.shape, field_index, key,
+                            path.view().substr(base_len)
+                        );
+                    }
+                    field_index++;
+                    if (frame.sorted)
+                    {
+                        frame.key = key;
+                    }
+                }
+                simdjson::ondemand::value child = field.value().value();
+                auto child_type = child.type().value();
+                if (is_container(child_type))
+                {
+                    frame.object_it = it;
+                    frame.field = field_index;
+                    frame.started = true;
+                    push(child, child_type, out);
+                    pushed = true;
+                    break;
+                }
+                print_scalar(child, child_type, out);
+                if (frame.sorted)
+                {
+                    add_sorted_field(frame);
+                }
             }
-            *ptr++ = 'm';
-        }
-        while (s.size() > 0 &&
-               (s[s.size() - 1] == ' ' || s[s.size() - 1] == '\n' ||
-                s[s.size() - 1] == '\r' || s[s.size() - 1] == '\t'))
-        {
-            s.remove_suffix(1);
-        }
-        memcpy(ptr, s.data(), s.size());
-        ptr += s.size();
-        if (flags & COLOR)
-        {
-            *ptr++ = '\033';
-            *ptr++ = '[';
-            *ptr++ = '0';
-            *ptr++ = 'm';
         }
-        if (flags & SEMICOLON)
+        if (pushed)
         {
-            *ptr++ = ';';
+            continue;
         }
-        *ptr++ = '\n';
-        string_view ss = string_view(
-            &out_growing_string.data[orig_out_len],
-            ptr - &out_growing_string.data[orig_out_len]
-        );
-        if (can_show(ss, flags, filters))
+        // All children were printed
+        if (frame.sorted)
         {
-            if (flags & COLORIZE_MATCHES)
-            {
-                ss = colorize_matches(ss, filters);
-                out_growing_string.append(ss);
-            }
-            else
+            std::sort(
+                frame.fields.begin(), frame.fields.end(),
+                [](auto &a, auto &b) { return a.first < b.first; }
+            );
+            for (auto &field : frame.fields)
             {
-                out_growing_string.len = ptr - &out_growing_string.data[0];
+                frame.out->append(field.second);
             }
         }
-        break;
+        path.erase(frame.orig_len);
+        depth--;
+        batched_print_flush_if_needed();
     }
+}
+
+void print_gron_document(
+    simdjson::ondemand::document_reference doc,
+    growing_string &path,
+    growing_string &out_growing_string,
+    const unsigned flags,
+    vector<string> &filters
+)
+{
+    simdjson::ondemand::json_type type = doc.type();
+    if (type == simdjson::ondemand::json_type::array ||
+        type == simdjson::ondemand::json_type::object)
+    {
+        simdjson::ondemand::value val = doc;
+        recursive_print_gron(val, path, out_growing_string, flags, filters);
+    }
+    else
+    {
+        print_gron_leaf(
+            path, type, doc.raw_json_token(), out_growing_string, flags,
+            filters
+        );
+        batched_print_flush_if_needed();
     }
-    batched_print_flush_if_needed();
 }
@@ -3,6 +3,7 @@
 #include "batched_print.hpp"
 #include "growing_string.hpp"
 #include "jsonutils.hpp"
+#include "key_scan.hpp"
 #include "simdjson.h"
 #include <iostream>
 #include <string>
@@ -20,9 +21,29 @@ void recursive_print_gron(
     vector<string> &filters
 );
 
+// Prints a whole document, which unlike a value may also be a scalar.
+void print_gron_document(
+    simdjson::ondemand::document_reference doc,
+    growing_string &path,
+    growing_string &out_growing_string,
+    const unsigned flags,
+    vector<string> &filters
+);
+
+// Prints path = value for a scalar whose JSON text is s, or only the path
+// with PATHS_ONLY, or only the value with VALUES_ONLY.
+void print_gron_leaf(
+    growing_string &path,
+    simdjson::ondemand::json_type type,
+    string_view s,
+    growing_string &out_growing_string,
+    const unsigned flags,
+    vector<string> &filters
+);
+
 inline growing_string &colorize_matches(string_view s, vector<string> &filters)
 {
-    static growing_string out;
+    static thread_local growing_string out;
     out.clear_mem();
     out.reserve_extra(s.size() + 100);
     while (s.size() > 0)
@@ -69,3 +90,103 @@ inline void gprint(
     }
     out_growing_string.append(s);
 }
+
+// Appends line as the number of its leading bytes shared with the previous
+// line, a space and the rest of it, for PREFIX_DELTA.
+inline void
+append_prefix_delta(growing_string &out, string_view line, size_t shared)
+{
+    char num[24];
+    char *end = simdjson::fast_itoa(num, shared);
+    out.reserve_extra(line.size() + sizeof(num));
+    out.append(string_view(num, end - num)).append(' ');
+    out.append(line.substr(shared));
+}
+
+// Prints path = [] or path = {}, leaving path unchanged. Only the path is
+// printed with PATHS_ONLY, and nothing with SKIP_INITIALIZERS or VALUES_ONLY.
+inline void print_container_init(
+    growing_string &path,
+    bool is_array,
+    growing_string &out_growing_string,
+    const unsigned flags,
+    vector<string> &filters
+)
+{
+    if (flags & (SKIP_INITIALIZERS | VALUES_ONLY))
+    {
+        return;
+    }
+    size_t base_len = path.size();
+    if (flags & PATHS_ONLY)
+        ;
+    else if (flags & SPACES)
+        if (flags & COLOR)
+            path.append(is_array ? " = \033[1;34m[]\033[0m"
+                                 : " = \033[1;34m{}\033[0m");
+        else
+            path.append(is_array ? " = []" : " = {}");
+    else if (flags & COLOR)
+        path.append(is_array ? "=\033[1;34m[]\033[0m" : "=\033[1;34m{}\033[0m");
+    else
+        path.append(is_array ? "=[]" : "={}");
+
+    if ((flags & SEMICOLON) && !(flags & PATHS_ONLY))
+    {
+        path.append(';');
+    }
+    path.append('\n');
+    if (flags & PREFIX_DELTA)
+    {
+        if (can_show(path, flags, filters))
+        {
+            append_prefix_delta(out_growing_string, path, path.unchanged_len);
+            path.unchanged_len = path.size();
+        }
+    }
+    else
+    {
+        gprint(path, out_growing_string, flags, filters);
+    }
+    path.erase(base_len);
+}
+
+// Appends .key or ["key"] to path, where key is the raw (escaped) JSON key
+// and identifier tells if it's a JavaScript identifier.
+inline void append_object_key(
+    growing_string &path,
+    string_view key,
+    bool identifier,
+    const unsigned flags
+)
+{
+    if (!identifier)
+    {
+        if (flags & COLOR)
+            path.append("\033[1;34m[\033[1;35m\"");
+        else
+            path.append("[\"");
+        path.append(key);
+        if (flags & COLOR)
+            path.append("\"\033[1;34m]\033[0m");
+        else
+            path.append("\"]");
+    }
+    else
+    {
+        path.append(".");
+        if (flags & COLOR)
+            path.append("\033[1;34m");
+        path.append(key);
+        if (flags & COLOR)
+            path.append("\033[0m");
+    }
+}
+
+inline void
+append_object_key(growing_string &path, string_view key, const unsigned flags)
+{
+    append_object_key(
+        path, key, active_key_scanner->is_identifier(key), flags
+    );
+}
@@ -2,13 +2,17 @@
 #include "batched_print.hpp"
 #include "jsonutils.hpp"
 
-void print_json_inner(
-    Builder &builder, const unsigned flags, growing_string &indent
-);
+// A container that print_json_inner is printing, with its next item
+struct json_frame
+{
+    Vector *vector = nullptr;
+    std::vector<Builder>::iterator vector_it;
+    Map *map = nullptr;
+    std::map<string, Builder>::iterator map_it;
+    bool first = true;
+};
 
-void print_vector(
-    Vector &vector_holder, const unsigned flags, growing_string &indent
-)
+void print_vector_start(const unsigned flags, growing_string &indent)
 {
     batched_out.append('[');
     if (flags & NEWLINE)
@@ -19,21 +23,10 @@ void print_vector(
     {
         indent.append("  ");
     }
-    bool first = true;
-    for (auto &item : vector_holder.vector)
-    {
-        if (!first)
-        {
-            batched_out.append(',');
-            if (flags & NEWLINE)
-            {
-                batched_out.append('\n');
-            }
-        }
-        first = false;
-        batched_print(indent.view());
-        print_json_inner(item, flags, indent);
-    }
+}
+
+void print_vector_end(const unsigned flags, growing_string &indent)
+{
     if (flags & INDENT)
     {
         indent.erase(indent.size() - 2);
@@ -47,7 +40,7 @@ void print_vector(
     batched_print("]");
 }
 
-void print_map(Map &map_holder, const unsigned flags, growing_string &indent)
+void print_map_start(const unsigned flags, growing_string &indent)
 {
     batched_print('{');
     if (flags & NEWLINE)
@@ -58,20 +51,10 @@ void print_map(Map &map_holder, const unsigned flags, growing_string &indent)
     {
         indent.append("  ");
     }
-    bool first = true;
-    for (auto &item : map_holder.map)
-    {
-        if (!first)
-        {
-            batched_print(",\n");
-        }
-        first = false;
-        batched_print(indent.view());
-        batched_print('"');
-        batched_print(item.first);
-        batched_print("\": ");
-        print_json_inner(item.second, flags, indent);
-    }
+}
+
+void print_map_end(const unsigned flags, growing_string &indent)
+{
     if (flags & INDENT)
     {
         indent.erase(indent.size() - 2);
@@ -84,27 +67,93 @@ void print_map(Map &map_holder, const unsigned flags, growing_string &indent)
     batched_print("}");
 }
 
+// Prints builder with a stack of containers instead of recursion, so deep
+// nesting doesn't overflow the call stack.
 void print_json_inner(
     Builder &builder, const unsigned flags, growing_string &indent
 )
 {
-    if (std::holds_alternative<string_variant>(builder))
+    std::vector<json_frame> stack;
+    Builder *next = &builder;
+    while (true)
     {
-        string_variant &s = std::get<string_variant>(builder);
-        if (s.empty())
+        if (next != nullptr)
+        {
+            if (std::holds_alternative<string_variant>(*next))
+            {
+                string_variant &s = std::get<string_variant>(*next);
+                if (s.empty())
+                {
+                    batched_print("null");
+                }
+                else
+                {
+                    batched_print(s);
+                }
+            }
+            else if (std::holds_alternative<Vector>(*next))
+            {
+                Vector &vector_holder = std::get<Vector>(*next);
+                print_vector_start(flags, indent);
+                json_frame &frame = stack.emplace_back();
+                frame.vector = &vector_holder;
+                frame.vector_it = vector_holder.vector.begin();
+            }
+            else if (std::holds_alternative<Map>(*next))
+            {
+                Map &map_holder = std::get<Map>(*next);
+                print_map_start(flags, indent);
+                json_frame &frame = stack.emplace_back();
+                frame.map = &map_holder;
+                frame.map_it = map_holder.map.begin();
+            }
+            next = nullptr;
+        }
+        if (stack.empty())
         {
-            batched_print("null");
-            return;
+            break;
+        }
+        json_frame &frame = stack.back();
+        if (frame.vector != nullptr)
+        {
+            if (frame.vector_it == frame.vector->vector.end())
+            {
+                stack.pop_back();
+                print_vector_end(flags, indent);
+                continue;
+            }
+            if (!frame.first)
+            {
+                batched_out.append(',');
+                if (flags & NEWLINE)
+                {
+                    batched_out.append('\n');
+                }
+            }
+            frame.first = false;
+            batched_print(indent.view());
+            next = &*frame.vector_it++;
+        }
+        else
+        {
+            if (frame.map_it == frame.map->map.end())
+            {
+                stack.pop_back();
+                print_map_end(flags, indent);
+                continue;
+            }
+            if (!frame.first)
+            {
+                batched_print(",\n");
+            }
+            frame.first = false;
+            batched_print(indent.view());
+            batched_print('"');
+            batched_print(frame.map_it->first);
+            batched_print("\": ");
+            next = &frame.map_it->second;
+            ++frame.map_it;
         }
-        batched_print(std::get<string_variant>(builder));
-    }
-    else if (std::holds_alternative<Vector>(builder))
-    {
-        print_vector(std::get<Vector>(builder), flags, indent);
-    }
-    else if (std::holds_alternative<Map>(builder))
-    {
-        print_map(std::get<Map>(builder), flags, indent);
     }
 }
 
@@ -115,4 +164,4 @@ void print_json(Builder &builder, const unsigned flags)
     print_json_inner(builder, flags, indent);
     batched_print("\n"); // Final newline is always printed
     batched_print_flush();
-}
\ No newline at end of file
+}
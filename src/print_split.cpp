@@ -0,0 +1,332 @@
+#include "print_split.hpp"
+#include "batched_print.hpp"
+#include "parallel.hpp"
+#include "print_gron.hpp"
+#include <algorithm>
+#include <cstring>
+
+// Consecutive elements of an array or object, without the brackets, or only
+// the = [] or = {} line of the container if begin is null
+struct piece
+{
+    // Path of the container
+    string path;
+    bool is_array;
+    const char *begin;
+    const char *end;
+    // Index of the first element if the container is an array
+    uint64_t first_index;
+};
+
+// A container too big to be one piece, whose members are split on their own
+struct descent
+{
+    // Its opening and closing brackets
+    const char *open;
+    const char *close;
+    // Whether its members were measured to find the ones too big in it
+    bool measured;
+};
+
+static bool is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Last non-space character before p
+static const char *before_spaces(const char *p)
+{
+    do
+    {
+        p--;
+    } while (is_space(*p));
+    return p;
+}
+
+// Cuts a document into pieces. Skipping an element only walks the structural
+// characters simdjson found while indexing the document, so the values aren't
+// parsed here.
+struct splitter
+{
+    size_t piece_size;
+    const unsigned flags;
+    vector<piece> pieces;
+    // In document order, which is the order they are reached in
+    vector<descent> descents;
+    size_t next_descent;
+    // Containers too big to be one piece that aren't in descents yet
+    vector<descent> found;
+
+    splitter(size_t piece_size, unsigned flags)
+        : piece_size(piece_size), flags(flags), next_descent(0)
+    {
+    }
+
+    // Adds the pieces of container, which ends at close, going into the
+    // members that are in descents. With measure, its other members that are
+    // too big are added to found.
+    void split(
+        simdjson::ondemand::value container,
+        bool is_array,
+        growing_string &path,
+        const char *close,
+        bool measure
+    )
+    {
+        const char *begin = nullptr;
+        uint64_t index = 0;
+        uint64_t first_index = 0;
+        // Adds the next member, whose JSON starts at start and its value at
+        // value_start, or goes into it
+        auto add_member = [&](simdjson::ondemand::value value,
+                              const char *start, const char *value_start)
+        {
+            if (next_descent < descents.size() &&
+                descents[next_descent].open == value_start)
+            {
+                const descent &d = descents[next_descent++];
+                if (begin != nullptr)
+                {
+                    pieces.push_back(
+                        {string(path), is_array, begin, before_spaces(start),
+                         first_index}
+                    );
+                    begin = nullptr;
+                }
+                size_t base_len = path.size();
+                if (is_array)
+                {
+                    char digits[24];
+                    auto end = simdjson::fast_itoa(digits, index);
+                    if (flags & COLOR)
+                        path.append("\033[1;34m[\033[1;32m");
+                    else
+                        path.append("[");
+                    path.append(string_view(digits, end - digits));
+                    if (flags & COLOR)
+                        path.append("\033[1;34m]\033[0m");
+                    else
+                        path.append("]");
+                }
+                else
+                {
+                    // Keys are in the padded document
+                    raw_key scanned =
+                        active_key_scanner->scan_padded_key(start + 1);
+                    append_object_key(
+                        path, string_view(start + 1, scanned.length),
+                        scanned.identifier, flags
+                    );
+                }
+                bool child_is_array = *value_start == '[';
+                pieces.push_back(
+                    {string(path), child_is_array, nullptr, nullptr, 0}
+                );
+                split(value, child_is_array, path, d.close, !d.measured);
+                path.erase(base_len);
+            }
+            else
+            {
+                if (begin == nullptr)
+                {
+                    begin = start;
+                    first_index = index;
+                }
+                else if ((size_t)(start - begin) >= piece_size)
+                {
+                    // The previous member ends before the comma
+                    pieces.push_back(
+                        {string(path), is_array, begin, before_spaces(start),
+                         first_index}
+                    );
+                    begin = start;
+                    first_index = index;
+                }
+                if (measure)
+                {
+                    measure_member(value, value_start);
+                }
+            }
+            index++;
+        };
+        if (is_array)
+        {
+            for (auto child : container.get_array())
+            {
+                simdjson::ondemand::value value = child.value();
+                const char *start = value.raw_json_token().data();
+                add_member(value, start, start);
+            }
+        }
+        else
+        {
+            for (auto field : container.get_object())
+            {
+                // Starting at the quote before the key
+                const char *start = field.key().value().raw() - 1;
+                simdjson::ondemand::value value = field.value().value();
+                add_member(value, start, value.raw_json_token().data());
+            }
+        }
+        if (begin != nullptr)
+        {
+            pieces.push_back(
+                {string(path), is_array, begin, close, first_index}
+            );
+        }
+    }
+
+    void measure_member(simdjson::ondemand::value value, const char *open)
+    {
+        std::string_view json;
+        if (*open == '[')
+        {
+            json = value.get_array().value().raw_json().value();
+        }
+        // A sorted object has to be printed as a whole
+        else if (*open == '{' && !(flags & SORT_OUTPUT))
+        {
+            json = value.get_object().value().raw_json().value();
+        }
+        if (json.size() > 2 * piece_size)
+        {
+            // The JSON ends with the spaces after the bracket
+            found.push_back(
+                {open, before_spaces(json.data() + json.size()), false}
+            );
+        }
+    }
+};
+
+// Parses a piece as an array or object of its own and prints its elements
+// with the paths they have in the whole document.
+static void print_piece(
+    const piece &p,
+    const unsigned flags,
+    vector<string> &filters
+)
+{
+    growing_string path(p.path);
+    if (p.begin == nullptr)
+    {
+        print_container_init(path, p.is_array, batched_out, flags, filters);
+        return;
+    }
+    thread_local simdjson::ondemand::parser parser;
+    thread_local growing_string text;
+    text.erase(0);
+    text.reserve_extra(p.end - p.begin + 2 + simdjson::SIMDJSON_PADDING);
+    text.append(p.is_array ? '[' : '{');
+    text.append(string_view(p.begin, p.end - p.begin));
+    text.append(p.is_array ? ']' : '}');
+    simdjson::ondemand::document doc = parser.iterate(
+        simdjson::padded_string_view(text.data, text.size(), text.capacity)
+    );
+
+    const bool build_path = !(flags & VALUES_ONLY) || (flags & SORT_OUTPUT);
+    if (p.is_array)
+    {
+        if (flags & COLOR)
+            path.append("\033[1;34m[\033[1;32m");
+        else
+            path.append("[");
+        size_t base_len = path.size();
+        uint64_t index = p.first_index;
+        for (auto child : doc.get_array())
+        {
+            char digits[24];
+            auto end = simdjson::fast_itoa(digits, index++);
+            path.append(string_view(digits, end - digits));
+            if (flags & COLOR)
+                path.append("\033[1;34m]\033[0m");
+            else
+                path.append("]");
+            recursive_print_gron(
+                child.value(), path, batched_out, flags, filters
+            );
+            path.erase(base_len);
+        }
+    }
+    else
+    {
+        size_t base_len = path.size();
+        for (auto field : doc.get_object())
+        {
+            if (build_path)
+            {
+                // Keys are in the padded piece
+                const char *raw = field.key().value().raw();
+                raw_key scanned = active_key_scanner->scan_padded_key(raw);
+                append_object_key(
+                    path, string_view(raw, scanned.length), scanned.identifier,
+                    flags
+                );
+            }
+            recursive_print_gron(
+                field.value().value(), path, batched_out, flags, filters
+            );
+            path.erase(base_len);
+        }
+    }
+}
+
+bool print_gron_split(
+    simdjson::ondemand::document &doc,
+    simdjson::padded_string_view json,
+    growing_string &path,
+    const unsigned flags,
+    vector<string> &filters,
+    unsigned threads,
+    size_t piece_size
+)
+{
+    if (flags & PREFIX_DELTA)
+    {
+        return false;
+    }
+    auto type = doc.type().value();
+    bool is_array = type == simdjson::ondemand::json_type::array;
+    if (!is_array && (type != simdjson::ondemand::json_type::object ||
+                      (flags & SORT_OUTPUT)))
+    {
+        return false;
+    }
+    // Goes into every array or object too big to be printed by one thread,
+    // like the features of a GeoJSON file or the rows of a table nested in
+    // an object. The containers found too big in one walk over the document
+    // are measured in the next one, until there are no more.
+    splitter s(piece_size, flags);
+    const char *close = before_spaces(json.data() + json.size());
+    bool measure_root = true;
+    while (true)
+    {
+        s.pieces.clear();
+        s.next_descent = 0;
+        doc.rewind();
+        s.split(doc, is_array, path, close, measure_root);
+        measure_root = false;
+        if (s.found.empty())
+        {
+            break;
+        }
+        for (auto &d : s.descents)
+        {
+            d.measured = true;
+        }
+        s.descents.insert(s.descents.end(), s.found.begin(), s.found.end());
+        s.found.clear();
+        std::sort(
+            s.descents.begin(), s.descents.end(),
+            [](const descent &a, const descent &b) { return a.open < b.open; }
+        );
+    }
+    print_container_init(path, is_array, batched_out, flags, filters);
+    thread_pool pool(threads);
+    // Few pieces ahead, the output of each can be several times its size
+    run_ordered(
+        pool, s.pieces.size(),
+        [&](size_t i) { print_piece(s.pieces[i], flags, filters); },
+        2 * threads
+    );
+    return true;
+}
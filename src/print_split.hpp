@@ -0,0 +1,24 @@
+#pragma once
+#include "growing_string.hpp"
+#include "simdjson.h"
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+// Prints a top level array or object like print_gron_document, but on
+// threads: its members are cut into pieces of about piece_size bytes, which
+// the workers parse and print as separate documents, and the output of the
+// pieces is written in order. Arrays and objects at any depth that are too
+// big for one piece are split the same way. Returns false without printing
+// anything if doc can't be split: a scalar, an object whose output is sorted,
+// or any document with PREFIX_DELTA, whose lines depend on the previous one.
+bool print_gron_split(
+    simdjson::ondemand::document &doc,
+    simdjson::padded_string_view json,
+    growing_string &path,
+    const unsigned flags,
+    vector<string> &filters,
+    unsigned threads,
+    size_t piece_size
+);
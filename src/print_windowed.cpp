@@ -0,0 +1,148 @@
+#include "print_windowed.hpp"
+#include "batched_print.hpp"
+#include "input_window.hpp"
+#include "print_gron.hpp"
+#include "simdjson.h"
+
+static void print_value(
+    input_window &window,
+    simdjson::ondemand::parser &parser,
+    growing_string &path,
+    const unsigned flags,
+    vector<string> &filters
+)
+{
+    size_t len = window.scan_value();
+    simdjson::ondemand::document doc = parser.iterate(window.view(len));
+    print_gron_document(doc, path, batched_out, flags, filters);
+    window.pos += len;
+}
+
+static void print_array(
+    input_window &window,
+    simdjson::ondemand::parser &parser,
+    growing_string &path,
+    const unsigned flags,
+    vector<string> &filters
+)
+{
+    print_container_init(path, true, batched_out, flags, filters);
+    window.expect('[');
+    size_t orig_base_len = path.size();
+    if (flags & COLOR)
+        path.append("\033[1;34m[\033[1;32m");
+    else
+        path.append("[");
+    size_t base_len = path.size();
+    char out[100];
+    uint64_t index = 0;
+    if (window.peek() == ']')
+    {
+        window.pos++;
+        path.erase(orig_base_len);
+        return;
+    }
+    while (true)
+    {
+        auto end = simdjson::fast_itoa(out, index++);
+        path.append(string_view(out, end - out));
+        if (flags & COLOR)
+            path.append("\033[1;34m]\033[0m");
+        else
+            path.append("]");
+        print_value(window, parser, path, flags, filters);
+        path.erase(base_len);
+        int c = window.peek();
+        window.pos++;
+        if (c == ']')
+        {
+            break;
+        }
+        if (c != ',')
+        {
+            window.pos--;
+            window.error("Expected , or ]");
+        }
+    }
+    path.erase(orig_base_len);
+}
+
+static void print_object(
+    input_window &window,
+    simdjson::ondemand::parser &parser,
+    growing_string &path,
+    const unsigned flags,
+    vector<string> &filters
+)
+{
+    print_container_init(path, false, batched_out, flags, filters);
+    window.expect('{');
+    size_t base_len = path.size();
+    if (window.peek() == '}')
+    {
+        window.pos++;
+        return;
+    }
+    while (true)
+    {
+        if (window.peek() != '"')
+        {
+            window.error("Expected object key");
+        }
+        size_t key_len = window.scan_value();
+        append_object_key(
+            path, string_view(window.buffer.data + window.pos + 1, key_len - 2),
+            flags
+        );
+        window.pos += key_len;
+        window.expect(':');
+        if (window.peek() == '[')
+        {
+            print_array(window, parser, path, flags, filters);
+        }
+        else
+        {
+            print_value(window, parser, path, flags, filters);
+        }
+        path.erase(base_len);
+        int c = window.peek();
+        window.pos++;
+        if (c == '}')
+        {
+            break;
+        }
+        if (c != ',')
+        {
+            window.pos--;
+            window.error("Expected , or }");
+        }
+    }
+}
+
+void print_gron_windowed(
+    int fd,
+    growing_string &path,
+    const unsigned flags,
+    vector<string> &filters
+)
+{
+    input_window window(fd);
+    simdjson::ondemand::parser parser;
+    switch (window.peek())
+    {
+    case '[':
+        print_array(window, parser, path, flags, filters);
+        break;
+    case '{':
+        print_object(window, parser, path, flags, filters);
+        break;
+    case -1:
+        window.error("Empty input");
+    default:
+        print_value(window, parser, path, flags, filters);
+    }
+    if (window.peek() != -1)
+    {
+        window.error("Unexpected data after the document");
+    }
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "growing_string.hpp"
+#include <string>
+#include <vector>
+using std::string;
+using std::vector;
+
+// Prints the document read from fd while holding only a window of it in
+// memory. The elements of a top level array, and of the arrays that are
+// direct members of a top level object, are parsed and printed one by one;
+// everything else has to fit in memory as a whole.
+void print_gron_windowed(
+    int fd,
+    growing_string &path,
+    const unsigned flags,
+    vector<string> &filters
+);
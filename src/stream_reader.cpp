@@ -0,0 +1,56 @@
+#include "stream_reader.hpp"
+#include "input_window.hpp"
+
+void read_document_batches(
+    std::unique_ptr<input_source> source,
+    const std::function<void(simdjson::padded_string_view)> &on_batch
+)
+{
+    input_window window(std::move(source));
+    json_scanner scanner;
+    // Number of bytes after window.pos that the scanner has already seen
+    size_t scanned = 0;
+    while (true)
+    {
+        bool more = window.read_more();
+        size_t complete = 0;
+        while (true)
+        {
+            size_t end = scanner.find_value_end(string_view(
+                window.buffer.data + window.pos + scanned,
+                window.buffer.len - window.pos - scanned
+            ));
+            if (end == json_scanner::npos)
+            {
+                scanned = window.buffer.len - window.pos;
+                break;
+            }
+            if (scanner.stray_bracket)
+            {
+                // Same error as parsing the whole input would give
+                window.pos += scanned + end;
+                window.error(simdjson::error_message(simdjson::TAPE_ERROR));
+            }
+            scanned += end;
+            complete = scanned;
+        }
+        if (!more && scanner.finish())
+        {
+            complete = scanned;
+        }
+        if (complete > 0)
+        {
+            on_batch(window.view(complete));
+            window.pos += complete;
+            scanned -= complete;
+        }
+        if (!more)
+        {
+            if (scanner.in_value())
+            {
+                window.error("Incomplete JSON document");
+            }
+            return;
+        }
+    }
+}
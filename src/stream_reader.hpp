@@ -0,0 +1,14 @@
+#pragma once
+#include "input_source.hpp"
+#include "simdjson.h"
+#include <functional>
+#include <memory>
+
+// Reads a stream of JSON documents (like NDJSON) from source as it arrives and
+// calls on_batch with every run of complete documents that was read, so that
+// they can be printed before the rest of the input is available. A document
+// that is cut off at the end of a read is kept for the next batch.
+void read_document_batches(
+    std::unique_ptr<input_source> source,
+    const std::function<void(simdjson::padded_string_view)> &on_batch
+);
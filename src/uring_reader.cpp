@@ -0,0 +1,283 @@
+#include "uring_reader.hpp"
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <linux/io_uring.h>
+#include <memory>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using std::cerr;
+
+// Size of each read and the number of reads in flight
+static const size_t block_size = 1 << 21;
+static const unsigned queue_depth = 8;
+
+// The rings of an io_uring instance, set up without liburing
+struct uring
+{
+    int fd = -1;
+    void *sq_ptr = MAP_FAILED;
+    size_t sq_len = 0;
+    void *cq_ptr = MAP_FAILED;
+    size_t cq_len = 0;
+    io_uring_sqe *sqes = (io_uring_sqe *)MAP_FAILED;
+    size_t sqes_len = 0;
+
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    io_uring_cqe *cqes;
+
+    bool init(unsigned entries)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (fd < 0)
+        {
+            return false;
+        }
+        sq_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_len = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            sq_len = cq_len = std::max(sq_len, cq_len);
+        }
+        sq_ptr = mmap(
+            nullptr, sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_SQ_RING
+        );
+        if (sq_ptr == MAP_FAILED)
+        {
+            return false;
+        }
+        if (params.features & IORING_FEAT_SINGLE_MMAP)
+        {
+            cq_ptr = sq_ptr;
+        }
+        else
+        {
+            cq_ptr = mmap(
+                nullptr, cq_len, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING
+            );
+            if (cq_ptr == MAP_FAILED)
+            {
+                return false;
+            }
+        }
+        sqes_len = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = (io_uring_sqe *)mmap(
+            nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            fd, IORING_OFF_SQES
+        );
+        if (sqes == MAP_FAILED)
+        {
+            return false;
+        }
+        char *sq = (char *)sq_ptr;
+        sq_tail = (unsigned *)(sq + params.sq_off.tail);
+        sq_mask = (unsigned *)(sq + params.sq_off.ring_mask);
+        sq_array = (unsigned *)(sq + params.sq_off.array);
+        char *cq = (char *)cq_ptr;
+        cq_head = (unsigned *)(cq + params.cq_off.head);
+        cq_tail = (unsigned *)(cq + params.cq_off.tail);
+        cq_mask = (unsigned *)(cq + params.cq_off.ring_mask);
+        cqes = (io_uring_cqe *)(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    ~uring()
+    {
+        if (sqes != MAP_FAILED)
+        {
+            munmap(sqes, sqes_len);
+        }
+        if (cq_ptr != MAP_FAILED && cq_ptr != sq_ptr)
+        {
+            munmap(cq_ptr, cq_len);
+        }
+        if (sq_ptr != MAP_FAILED)
+        {
+            munmap(sq_ptr, sq_len);
+        }
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    // Queues a read of len bytes at offset of file into buf.
+    void queue_read(int file, char *buf, size_t len, size_t offset, size_t tag)
+    {
+        unsigned tail = *sq_tail;
+        unsigned index = tail & *sq_mask;
+        io_uring_sqe &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READ;
+        sqe.fd = file;
+        sqe.addr = (unsigned long)buf;
+        sqe.len = len;
+        sqe.off = offset;
+        sqe.user_data = tag;
+        sq_array[index] = index;
+        __atomic_store_n(sq_tail, tail + 1, __ATOMIC_RELEASE);
+    }
+
+    // Submits the queued reads and waits for at least one to complete.
+    int enter(unsigned to_submit)
+    {
+        while (true)
+        {
+            int r = syscall(
+                __NR_io_uring_enter, fd, to_submit, 1, IORING_ENTER_GETEVENTS,
+                nullptr, 0
+            );
+            if (r >= 0 || errno != EINTR)
+            {
+                return r;
+            }
+        }
+    }
+};
+
+bool uring_read_file(int fd, char *buf, size_t len)
+{
+    // A single read is just as fast for small files
+    if (len <= block_size)
+    {
+        return false;
+    }
+    // The ring is set up once per thread and kept for later files
+    thread_local std::unique_ptr<uring> ring_ptr;
+    thread_local bool unavailable = false;
+    if (!ring_ptr && !unavailable)
+    {
+        ring_ptr = std::make_unique<uring>();
+        if (!ring_ptr->init(queue_depth))
+        {
+            ring_ptr.reset();
+            unavailable = true;
+        }
+    }
+    if (unavailable)
+    {
+        return false;
+    }
+    uring &ring = *ring_ptr;
+    // Byte range of each read in flight, indexed by its tag
+    struct slot
+    {
+        size_t offset, len;
+    } slots[queue_depth];
+    size_t free_slots[queue_depth];
+    size_t free_count = queue_depth;
+    for (size_t i = 0; i < queue_depth; i++)
+    {
+        free_slots[i] = i;
+    }
+    size_t next = 0;
+    size_t done = 0;
+    unsigned to_submit = 0;
+    bool started = false;
+    bool completed = false;
+    // Set if the kernel has io_uring but can't read through it (before 5.6),
+    // then only the reads in flight are waited for, since they may still
+    // write to buf
+    bool unsupported = false;
+    while (unsupported ? free_count < queue_depth : done < len)
+    {
+        while (!unsupported && free_count > 0 && next < len)
+        {
+            size_t tag = free_slots[--free_count];
+            slots[tag] = {next, std::min(block_size, len - next)};
+            ring.queue_read(fd, buf + next, slots[tag].len, next, tag);
+            next += slots[tag].len;
+            to_submit++;
+        }
+        int submitted = ring.enter(to_submit);
+        if (submitted < 0)
+        {
+            if (!started)
+            {
+                // Reading through io_uring isn't allowed here
+                unavailable = true;
+                ring_ptr.reset();
+                return false;
+            }
+            cerr << "Failed to read file\n";
+            exit(EXIT_FAILURE);
+        }
+        started = true;
+        to_submit -= submitted;
+        unsigned head = *ring.cq_head;
+        unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            io_uring_cqe &cqe = ring.cqes[head & *ring.cq_mask];
+            slot &s = slots[cqe.user_data];
+            if (!completed && (cqe.res == -EINVAL || cqe.res == -EOPNOTSUPP))
+            {
+                unsupported = true;
+            }
+            if (unsupported)
+            {
+                free_slots[free_count++] = cqe.user_data;
+                continue;
+            }
+            completed = true;
+            if (cqe.res <= 0)
+            {
+                if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+                {
+                    // Retried below like a short read
+                }
+                else if (cqe.res == 0)
+                {
+                    cerr << "File got shorter while reading it\n";
+                    exit(EXIT_FAILURE);
+                }
+                else
+                {
+                    cerr << "Failed to read file: " << strerror(-cqe.res)
+                         << "\n";
+                    exit(EXIT_FAILURE);
+                }
+            }
+            size_t got = cqe.res > 0 ? cqe.res : 0;
+            done += got;
+            if (got < s.len)
+            {
+                // Read the rest of a short read again
+                s.offset += got;
+                s.len -= got;
+                ring.queue_read(
+                    fd, buf + s.offset, s.len, s.offset, cqe.user_data
+                );
+                to_submit++;
+            }
+            else
+            {
+                free_slots[free_count++] = cqe.user_data;
+            }
+        }
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    }
+    if (unsupported)
+    {
+        unavailable = true;
+        ring_ptr.reset();
+        return false;
+    }
+    return true;
+}
+
+#else
+
+bool uring_read_file(int, char *, size_t) { return false; }
+
+#endif
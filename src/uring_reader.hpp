@@ -0,0 +1,10 @@
+#pragma once
+#include <cstddef>
+
+// Reads the first len bytes of the regular file fd into buf using io_uring,
+// keeping several big reads in flight so the device never waits for the
+// previous one to be copied. Returns false without reading anything if
+// io_uring isn't available (old kernel, seccomp, non-Linux), in which case
+// the caller should fall back to read(). Files that fit in a single read are
+// left to read() too.
+bool uring_read_file(int fd, char *buf, size_t len);